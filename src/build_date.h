@@ -0,0 +1 @@
+#define BUILD_DATE "2026-10-19 14:14:21 UTC"
@@ -212,6 +212,17 @@ size_t comErall(st_line *line, size_t tokpos)
 			cout << "Pictures deleted.\n";
 		}
 	}
+	if (com == COM_ERALL && sprites.size())
+	{
+		for(auto &[name,sprite]: sprites) sprite->hide();
+		sprites.clear();
+		cout << "Sprites deleted.\n";
+	}
+	if (com == COM_ERALL && shapes.size())
+	{
+		shapes.clear();
+		cout << "Shapes deleted.\n";
+	}
 	if (com == COM_ERALL)
 	{
 		if (watch_vars.size())
@@ -332,7 +343,7 @@ size_t comPosf(st_line *line, size_t tokpos)
 	puts("------------");
 	printf("Indentation is %s.\n",flags.indent_label_blocks ? "on" : "off");
 	printf("Fill is %s.\n",
-		flags.graphics_enabled && turtle->fill_shape ? "on" : "off");
+		flags.graphics_enabled && turtle && turtle->fill_shape ? "on" : "off");
 	
 	return tokpos + 1;
 }
@@ -553,6 +564,7 @@ size_t comWait(st_line *line, size_t tokpos)
 	st_value &val = result.first;
 	if (val.type != TYPE_NUM || val.num < 0)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	if (flags.graphics_enabled) xFlush(true);
 	usleep(val.num * 1000000);
 
 	return result.second;
@@ -613,6 +625,62 @@ size_t comRepeat(st_line *line, size_t tokpos)
 
 
 
+/*** Format: FOREACH "<procedure>" <list or string>. Calls the procedure with
+     each element in turn ignoring any return value. As with REPEAT a STOP
+     only stops the looping. ***/
+size_t comForEach(st_line *line, size_t tokpos)
+{
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+
+	// Get procedure name
+	t_result result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	st_user_proc *proc = getUserProc(result.first.str);
+
+	// Get list or string
+	tokpos = result.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	result = line->evalExpression(tokpos);
+	st_value &inval = result.first;
+	vector<st_value> args(1);
+	size_t cnt;
+
+	switch(inval.type)
+	{
+	case TYPE_STR:
+		cnt = inval.str.size();
+		break;
+	case TYPE_LIST:
+		cnt = inval.listline->listSize();
+		break;
+	default:
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+
+	try
+	{
+		for(size_t i=0;i < cnt;++i)
+		{
+			if (inval.type == TYPE_STR)
+				args[0].set(string(1,inval.str[i]));
+			else if (i < inval.listline->listSize())
+				args[0] = inval.listline->getListElement(i+1);
+			else
+				break;
+			callUserProc(line,proc,args);
+		}
+	}
+	catch(t_interrupt &inter)
+	{
+		if (inter.first != INT_STOP) throw;
+	}
+	return result.second;
+}
+
+
+
+
 size_t comIf(st_line *line, size_t tokpos)
 {
 	++tokpos;
@@ -707,6 +775,7 @@ size_t comOp(st_line *line, size_t tokpos)
      switch is worth the huge reduction in duplicated code ***/
 size_t comGraphics0Args(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	int com = line->tokens[tokpos].subtype;
 
 	if (com != COM_TG && !flags.graphics_enabled)
@@ -758,6 +827,15 @@ size_t comGraphics0Args(st_line *line, size_t tokpos)
 	case COM_FILL:
 		turtle->fill();
 		break;
+	case COM_BEGINFRAME:
+		xBeginFrame();
+		break;
+	case COM_ENDFRAME:
+		xEndFrame(true);
+		break;
+	case COM_MIRROR:
+		turtle->setMirror(!turtle->mirror);
+		break;
 	case COM_TG:
 		// Toggles between graphics enabled and disabled
 		if (flags.graphics_enabled)
@@ -781,30 +859,67 @@ size_t comGraphics0Args(st_line *line, size_t tokpos)
 /*** Graphics commands with 1 argument ***/
 size_t comGraphics1Arg(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
 
 	int com = line->tokens[tokpos].subtype;
 	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
 	t_result result = line->evalExpression(tokpos);
 	st_value &val = result.first;
-	if (com != COM_SETLS && val.type != TYPE_NUM)
+	vector<double> nums;
+
+	// A shape definition only ever uses the current turtle
+	bool group = turtle->told.size() > 1 && !turtle->recording;
+
+	if (com == COM_POLYLINE || com == COM_PLOTPOINTS)
+	{
+		// List of x,y pairs
+		if (val.type != TYPE_LIST)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+		val.listline->getListNumbers(nums);
+		if (nums.empty() || nums.size() % 2)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+	else if (com == COM_TRANSFORM)
+	{
+		// a b c d e f
+		if (val.type != TYPE_LIST)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+		val.listline->getListNumbers(nums);
+		if (nums.size() != 6)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+	else if (com == COM_TELL)
+	{
+		// Turtle id or list of them
+		if (val.type == TYPE_LIST)
+			val.listline->getListNumbers(nums);
+		else if (val.type == TYPE_NUM)
+			nums.push_back(val.num);
+		else
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+	else if (com != COM_SETLS && val.type != TYPE_NUM)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 
 	switch(com)
 	{
 	case COM_FD:
-		turtle->move(val.num);
-		break;
 	case COM_BK:
-		turtle->move(-val.num);
+		if (com == COM_BK) val.num = -val.num;
+		if (group)
+			turtle->moveTold(val.num);
+		else
+			turtle->move(val.num);
 		break;
 	case COM_LT:
-		if (!flags.angle_in_degs) val.num *= DEGS_PER_RADIAN;
-		turtle->rotate(-val.num);
-		break;
 	case COM_RT:
 		if (!flags.angle_in_degs) val.num *= DEGS_PER_RADIAN;
-		turtle->rotate(val.num);
+		if (com == COM_LT) val.num = -val.num;
+		if (group)
+			turtle->rotateTold(val.num);
+		else
+			turtle->rotate(val.num);
 		break;
 	case COM_SETPC:
 		turtle->setColour((int)val.num);
@@ -819,12 +934,17 @@ size_t comGraphics1Arg(st_line *line, size_t tokpos)
 		turtle->setY(val.num);
 		break;
 	case COM_SETH:
-		turtle->setAngle(val.num);
+		if (group)
+			turtle->setAngleTold(val.num);
+		else
+			turtle->setAngle(val.num);
 		break;
 	case COM_SETSZ:
 		turtle->setSize(val.num);
 		break;
 	case COM_SETLW:
+		if (val.num < 1 || val.num > MAX_LINE_WIDTH)
+			throw t_error({ ERR_INVALID_ARG, numToString(val.num) });
 		turtle->setLineWidth((int)val.num);
 		break;
 	case COM_SETLS:
@@ -832,6 +952,39 @@ size_t comGraphics1Arg(st_line *line, size_t tokpos)
 			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 		turtle->setLineStyle(val.str);
 		break;
+	case COM_SETREFRESH:
+		xSetRefresh(val.num);
+		break;
+	case COM_SETFRAMERATE:
+		xSetFrameRate(val.num);
+		break;
+	case COM_SETMAXPRIMS:
+		if (val.num < 0 || val.num > INT_MAX || val.num != floor(val.num))
+			throw t_error({ ERR_INVALID_ARG, numToString(val.num) });
+		xSetMaxPrims((int)val.num);
+		break;
+	case COM_POLYLINE:
+		turtle->drawPolyline(nums);
+		break;
+	case COM_PLOTPOINTS:
+		turtle->plotPoints(nums);
+		break;
+	case COM_TRANSFORM:
+		turtle->transform(nums);
+		break;
+	case COM_SYMMETRY:
+		if (val.num < 1 || val.num > MAX_SYMMETRY || val.num != floor(val.num))
+			throw t_error({ ERR_INVALID_ARG, numToString(val.num) });
+		turtle->setSymmetry((int)val.num);
+		break;
+	case COM_NEWTURTLE:
+		if (val.num < 1 || val.num > MAX_TURTLES || val.num != floor(val.num))
+			throw t_error({ ERR_INVALID_ARG, numToString(val.num) });
+		turtle->newTurtles((int)val.num);
+		break;
+	case COM_TELL:
+		turtle->tell(nums);
+		break;
 	default:
 		assert(0);
 	}
@@ -843,16 +996,34 @@ size_t comGraphics1Arg(st_line *line, size_t tokpos)
 
 /*** In Dr Logo this would be a 2 argument list which is fair enough as
      it means only 1 argument follows, but I prefer standalone args.
-     CIRC takes 3 arguments but can't be bothered to have a seperate func ***/
-size_t comGraphics23Args(st_line *line, size_t tokpos)
+     CIRC and the curves take more arguments but can't be bothered to have
+     seperate funcs ***/
+size_t comGraphicsNArgs(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
 	if (line->tokens.size() - tokpos < 2)
 		throw t_error({ ERR_MISSING_ARG, "" });
 
 	int com = line->tokens[tokpos].subtype;
-	int cnt = (com == COM_CIRC ? 3 : 2);
+	int cnt;
+
+	switch(com)
+	{
+	case COM_CIRC:
+		cnt = 3;
+		break;
+	case COM_QBEZIER:
+		cnt = 4;
+		break;
+	case COM_CBEZIER:
+		cnt = 6;
+		break;
+	default:
+		cnt = 2;
+	}
 	st_value val[cnt];
+	double nums[cnt];
 	size_t tokpos2 = tokpos + 1;
 
 	// Get arguments, all numeric
@@ -865,6 +1036,7 @@ size_t comGraphics23Args(st_line *line, size_t tokpos)
 		val[i] = res.first;
 		if (val[i].type != TYPE_NUM)
 			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos2].toString() });
+		nums[i] = val[i].num;
 	}
 
 	switch(com)
@@ -888,6 +1060,20 @@ size_t comGraphics23Args(st_line *line, size_t tokpos)
 	case COM_CIRC:
 		turtle->drawCircle(val[0].num,val[1].num,(bool)val[2].num);
 		break;
+	case COM_ARC:
+		if (!flags.angle_in_degs) val[1].num *= DEGS_PER_RADIAN;
+		turtle->drawArc(val[0].num,val[1].num);
+		break;
+	case COM_POLY:
+		// Check before the cast as it's undefined outside int range
+		if (val[0].num < 1 || val[0].num > MAX_POLY_SIDES)
+			throw t_error({ ERR_INVALID_ARG, numToString(val[0].num) });
+		turtle->drawPoly((int)val[0].num,val[1].num);
+		break;
+	case COM_QBEZIER:
+	case COM_CBEZIER:
+		turtle->drawBezier(nums,cnt);
+		break;
 	default:
 		assert(0);
 	}
@@ -899,6 +1085,7 @@ size_t comGraphics23Args(st_line *line, size_t tokpos)
 
 size_t comPicture(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
 	int com = line->tokens[tokpos].subtype;
 
@@ -908,7 +1095,7 @@ size_t comPicture(st_line *line, size_t tokpos)
 	if (result.first.type != TYPE_STR)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 
-	string &name = result.first.str;
+	const string &name = result.first.str;
 
 	auto it = pictures.find(name);
 	if (it == pictures.end()) throw t_error({ ERR_INVALID_PICTURE, name });
@@ -928,6 +1115,216 @@ size_t comPicture(st_line *line, size_t tokpos)
 }
 
 
+/*** DEFSHAPE "<name>" [<commands>] or STAMP "<name>" ***/
+size_t comShape(st_line *line, size_t tokpos)
+{
+	xWaitConnect();
+	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
+	int com = line->tokens[tokpos].subtype;
+
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+
+	t_result result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+	string name = result.first.str;
+	if (com == COM_STAMP)
+	{
+		turtle->stamp(name);
+		return result.second;
+	}
+
+	tokpos = result.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+
+	result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_LIST)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+	turtle->defineShape(name,result.first.listline);
+	return result.second;
+}
+
+
+/*** LDRAW <string> <step> <angle> ***/
+size_t comLDraw(st_line *line, size_t tokpos)
+{
+	xWaitConnect();
+	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
+
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	st_value str = result.first;
+	double nums[2];
+
+	for(int i=0;i < 2;++i)
+	{
+		tokpos = result.second;
+		if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+		result = line->evalExpression(tokpos);
+		if (result.first.type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+		nums[i] = result.first.num;
+	}
+	if (!flags.angle_in_degs) nums[1] *= DEGS_PER_RADIAN;
+
+	turtle->lDraw(str.str,nums[0],nums[1]);
+	return result.second;
+}
+
+
+/*** ASK <turtle id or list> [<commands>]
+     Runs the commands once for each turtle with just it told then puts back
+     the turtles that were told before ***/
+size_t comAsk(st_line *line, size_t tokpos)
+{
+	xWaitConnect();
+	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
+
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result result = line->evalExpression(tokpos);
+	vector<double> ids;
+
+	if (result.first.type == TYPE_LIST)
+		result.first.listline->getListNumbers(ids);
+	else if (result.first.type == TYPE_NUM)
+		ids.push_back(result.first.num);
+	else
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+	tokpos = result.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_LIST)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+	// Check them all before running anything
+	if (turtle->recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+	for(double id: ids)
+	{
+		if (id < 0 || id >= turtle->turtles_x.size() || id != (int)id)
+			throw t_error({ ERR_INVALID_ARG, numToString(id) });
+	}
+
+	vector<double> told(turtle->told.begin(),turtle->told.end());
+	vector<double> one(1);
+
+	// A CS in the commands gets rid of all but turtle 0 so any turtles 
+	// that have gone are skipped and not told again afterwards
+	auto restore = [&]()
+	{
+		vector<double> still;
+		for(double id: told)
+			if (id < turtle->turtles_x.size()) still.push_back(id);
+		if (still.empty()) still.push_back(0);
+		turtle->tell(still);
+	};
+
+	try
+	{
+		for(double id: ids)
+		{
+			if (id >= turtle->turtles_x.size()) continue;
+			one[0] = id;
+			turtle->tell(one);
+			result.first.listline->execute();
+		}
+	}
+	catch(t_interrupt &inter)
+	{
+		// As with REPEAT a STOP only stops the ASK
+		if (inter.first != INT_STOP)
+		{
+			restore();
+			throw;
+		}
+	}
+	catch(...)
+	{
+		restore();
+		throw;
+	}
+	restore();
+	return result.second;
+}
+
+
+/*** SPRITE "<name>" "<picture or shape>"
+     MOVESPRITE "<name>" <x> <y>
+     HIDESPRITE "<name>" ***/
+size_t comSprite(st_line *line, size_t tokpos)
+{
+	xWaitConnect();
+	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
+	int com = line->tokens[tokpos].subtype;
+
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	string name = result.first.str;
+
+	if (com == COM_SPRITE)
+	{
+		tokpos = result.second;
+		if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+		result = line->evalExpression(tokpos);
+		if (result.first.type != TYPE_STR)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+		// Pictures first then shapes
+		const string &from = result.first.str;
+		shared_ptr<st_sprite> sprite;
+		auto pit = pictures.find(from);
+		if (pit != pictures.end())
+			sprite = make_shared<st_sprite>(pit->second.get());
+		else
+		{
+			auto sit = shapes.find(from);
+			if (sit == shapes.end())
+				throw t_error({ ERR_INVALID_ARG, from });
+			sprite = make_shared<st_sprite>(
+				sit->second,turtle->angle,
+				turtle->size / TURTLE_SIZE,turtle->pen_colour);
+		}
+
+		// Replacing an old one
+		auto it = sprites.find(name);
+		if (it != sprites.end()) it->second->hide();
+
+		sprites[name] = sprite;
+		sprite->moveTo(turtle->x,turtle->y);
+		return result.second;
+	}
+
+	auto it = sprites.find(name);
+	if (it == sprites.end()) throw t_error({ ERR_UNDEFINED_SPRITE, name });
+
+	if (com == COM_HIDESPRITE)
+	{
+		it->second->hide();
+		return result.second;
+	}
+
+	// MOVESPRITE
+	double nums[2];
+	for(int i=0;i < 2;++i)
+	{
+		tokpos = result.second;
+		if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+		result = line->evalExpression(tokpos);
+		if (result.first.type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+		nums[i] = result.first.num;
+	}
+	it->second->moveTo(nums[0],nums[1]);
+	return result.second;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -952,7 +1349,7 @@ size_t comSave(st_line *line, size_t tokpos)
 	t_result result = line->evalExpression(tokpos);
 	if (result.first.type != TYPE_STR || result.first.str == "")
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
-	string &filepath = result.first.str;
+	const string &filepath = result.first.str;
 	string procname;
 	size_t endpos = result.second;
 	bool psave = false;
@@ -1043,7 +1440,7 @@ size_t comCD(st_line *line, size_t tokpos)
 	if (result.first.type != TYPE_STR || result.first.str == "")
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 
-	string &matchpath = result.first.str;
+	string matchpath = result.first.str;
 	if (pathHasWildCards(matchpath))
 	{
 		char *dirname;
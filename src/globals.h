@@ -12,18 +12,23 @@
 #include <time.h>
 #include <pwd.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
 #include <sys/stat.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <arpa/inet.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
 
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 #include <deque>
+#include <list>
 #include <stack>
 #include <map>
 #include <set>
@@ -32,6 +37,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <string_view>
+#include <future>
 
 using namespace std;
 
@@ -44,7 +51,7 @@ using namespace std;
 // System
 #define LOGO_INTERPRETER   "NRJ-LOGO"
 #define LOGO_COPYRIGHT     "Copyright (C) Neil Robertson 2020-2023"
-#define LOGO_VERSION       "1.7.0"
+#define LOGO_VERSION       "1.8.0"
 #define LOGO_PROC_FILE_EXT ".lg"
 #define LOGO_PIC_FILE_EXT  ".lp"
 
@@ -79,6 +86,17 @@ using namespace std;
 #define STDIN             0
 #define MAX_NEST_DEPTH    100
 #define MAX_HISTORY_LINES 100
+#define DEF_REFRESH_HZ    50
+#define DEF_FRAME_RATE    60
+#define DEF_MAX_PRIMS     100000
+#define MAX_LINE_WIDTH    1000
+#define GC_CACHE_SIZE     64
+#define MAX_LSYSTEM_LEN   100000000
+#define MAX_LSYSTEM_ITERS 1000
+#define MAX_POLY_SIDES    10000
+#define MAX_SYMMETRY      360
+#define MAX_TURTLES       10000
+#define TURTLE_SIZE       20
 #define DEF_LIST_STR      "[<LIST>]" // Should never see in output
 #define OP_LIST_STR       ":;[]()=<>+-*/%^"
 
@@ -276,6 +294,40 @@ enum en_com
 	COM_ERPIC,
 	COM_ERPICS,
 	COM_SETPIC,
+	COM_FOREACH,
+
+	// 90
+	COM_SETREFRESH,
+	COM_BEGINFRAME,
+	COM_ENDFRAME,
+	COM_SETFRAMERATE,
+	COM_SETMAXPRIMS,
+
+	// 95
+	COM_ARC,
+	COM_POLY,
+	COM_QBEZIER,
+	COM_CBEZIER,
+	COM_POLYLINE,
+
+	// 100
+	COM_PLOTPOINTS,
+	COM_DEFSHAPE,
+	COM_STAMP,
+	COM_TRANSFORM,
+	COM_SYMMETRY,
+
+	// 105
+	COM_MIRROR,
+	COM_LDRAW,
+	COM_NEWTURTLE,
+	COM_TELL,
+	COM_ASK,
+
+	// 110
+	COM_SPRITE,
+	COM_MOVESPRITE,
+	COM_HIDESPRITE,
 
 	NUM_COMS
 };
@@ -362,6 +414,28 @@ enum en_sproc
 
 	// 55
 	SPROC_GETPICS,
+	SPROC_MAP,
+	SPROC_FILTER,
+	SPROC_REDUCE,
+
+	// 60
+	SPROC_SORT,
+	SPROC_VADD,
+	SPROC_VSUB,
+	SPROC_VMUL,
+	SPROC_VDIV,
+
+	// 65
+	SPROC_VMOD,
+	SPROC_VPWR,
+	SPROC_VSCALE,
+	SPROC_VSUM,
+	SPROC_VDOT,
+
+	// 70
+	SPROC_RANGE,
+	SPROC_ITERATE,
+	SPROC_LSYSTEM,
 
 	NUM_SPROCS
 };
@@ -442,6 +516,13 @@ enum en_error
 	// 50
 	ERR_INVALID_RLE,
 	ERR_INVALID_PICTURE,
+	ERR_NO_RETURN_VALUE,
+	ERR_UNDEFINED_SHAPE,
+	ERR_CANT_IN_SHAPE,
+
+	// 55
+	ERR_LSYSTEM_TOO_LONG,
+	ERR_UNDEFINED_SPRITE,
 
 	NUM_ERRORS
 };
@@ -528,16 +609,61 @@ struct st_io
 };
 
 
+/*** String that shares an immutable buffer with its copies and substrings
+     so copying and slicing don't copy any characters. A real std::string is
+     only created when one is asked for and the buffer isn't an exact match.
+     The members are mutable as that counts as a cache update, not a change
+     to the value. ***/
+struct st_string
+{
+	mutable shared_ptr<const string> buf;
+	mutable size_t off;
+	size_t len;
+
+	st_string();
+	st_string(const string &s);
+	st_string(string &&s);
+	st_string(const char *s);
+
+	size_t size() const;
+	size_t length() const;
+	bool   empty() const;
+	char   operator[](size_t pos) const;
+	char   front() const;
+	char   back() const;
+	const char *begin() const;
+	const char *end() const;
+	size_t find(const st_string &rhs) const;
+	st_string substr(size_t pos, size_t cnt=string::npos) const;
+	string_view view() const;
+	const string &get() const;
+	const char *c_str() const;
+	void clear();
+
+	operator const string&() const;
+	void operator+=(const st_string &rhs);
+};
+
+bool operator==(const st_string &lhs, const st_string &rhs);
+bool operator!=(const st_string &lhs, const st_string &rhs);
+bool operator<(const st_string &lhs, const st_string &rhs);
+bool operator>(const st_string &lhs, const st_string &rhs);
+bool operator<=(const st_string &lhs, const st_string &rhs);
+bool operator>=(const st_string &lhs, const st_string &rhs);
+string operator+(const st_string &lhs, const st_string &rhs);
+
+
 struct st_value
 {
 	int type;
 	double num;
-	string str;
+	st_string str;
 	shared_ptr<st_line> listline;
 
 	st_value();
 	st_value(double _num);
 	st_value(string _str);
+	st_value(const st_string &_str);
 	st_value(const char *_str);
 	st_value(const st_value &rval);
 	st_value(st_token &tok);
@@ -547,6 +673,7 @@ struct st_value
 	void reset();
 	void set(double _num);
 	void set(string _str);
+	void set(const st_string &_str);
 	void set(const char *_str);
 	void set(shared_ptr<st_line> _listline);
 	void set(const st_value &rval);
@@ -609,6 +736,19 @@ struct st_token
 };
 
 
+/*** A numeric list created by RANGE or ITERATE. Elements are calculated on
+     demand and tokens are only created if a real list is required ***/
+struct st_range
+{
+	double from;
+	double step;
+	size_t cnt;
+
+	st_range(double _from, double _step, size_t _cnt);
+	double element(size_t index);
+};
+
+
 struct st_line
 {
 	int type;
@@ -616,6 +756,7 @@ struct st_line
 	vector<st_token> tokens;
 	map<string,size_t> labels;
 	st_user_proc *parent_proc;
+	shared_ptr<st_range> range;
 
 	st_line();
 	st_line(bool is_list);
@@ -652,12 +793,17 @@ struct st_line
 
 	shared_ptr<st_line> evalList();
 	void listShuffle();
+	void expandRange();
 
+	size_t listSize();
 	st_value getListElement(int index);
 	shared_ptr<st_line> getListPiece(size_t from, size_t to);
+	void getListNumbers(vector<double> &nums);
 
 	shared_ptr<st_line> setListFirst(st_value &val);
 	shared_ptr<st_line> setListLast(st_value &val);
+	void setListNumbers(vector<double> &nums);
+	void setListRange(double from, double step, size_t cnt);
 	void setLineNum(int _linenum);
 
 	size_t listMemberp(st_value &val);
@@ -715,6 +861,7 @@ struct st_user_proc_inst
 	st_user_proc_inst(st_user_proc *_proc): proc(_proc), ret_set(false) { }
 
 	size_t setParams(st_line *line, size_t tokpos);
+	void   setParams(vector<st_value> &args);
 	void   setLocalVar(string &name, st_value &val);
 	t_var_map::iterator getLocalVar(const char *name);
 	bool   getLocalVarValue(string &name, st_value &val);
@@ -722,9 +869,44 @@ struct st_user_proc_inst
 };
 
 
+enum en_prim
+{
+	PRIM_LINE,
+	PRIM_DOT,
+	PRIM_CIRCLE,
+	PRIM_POLYGON,
+	PRIM_POLYLINE,
+	PRIM_POINTS,
+	PRIM_STAMP,
+	PRIM_SEGMENTS
+};
+
+
+// Identifies a line, solid ones whichever way round they were drawn
+struct st_line_key
+{
+	uint64_t ends;
+	uint32_t attrs;
+
+	bool operator==(const st_line_key &rhs) const
+	{
+		return ends == rhs.ends && attrs == rhs.attrs;
+	}
+};
+
+
+struct st_line_key_hash
+{
+	size_t operator()(const st_line_key &key) const
+	{
+		return hash<uint64_t>()(key.ends ^ ((uint64_t)key.attrs << 32));
+	}
+};
+
+
 struct st_turtle_line
 {
-	int colour;
+	int colour; // -1 if superseded by an identical later line
 	int width;
 	int style;
 	XPoint from;
@@ -734,6 +916,66 @@ struct st_turtle_line
 		int col, int wd, int st,
 		double xf, double yf, double xt, double yt);
 	void draw();
+	void getWrapPieces(vector<XSegment> &pieces);
+	bool extend(const st_turtle_line &next);
+	st_line_key key();
+};
+
+
+// Lines joined end to end drawn with a single request
+struct st_turtle_polyline
+{
+	int colour;
+	int width;
+	int style;
+	vector<XPoint> pnts;
+
+	st_turtle_polyline(int col, int wd, int st);
+	void addPoint(double x, double y);
+	void draw();
+};
+
+
+// Seperate lines drawn together when a group of turtles all move at once
+struct st_turtle_segments
+{
+	int colour;
+	int width;
+	int style;
+	vector<XSegment> segs;
+
+	st_turtle_segments(int col, int wd, int st);
+	void addSegment(double xf, double yf, double xt, double yt);
+	void draw();
+};
+
+
+// A shape recorded by DEFSHAPE relative to the turtle starting at 0,0
+// heading up. A colour of -1 means use the pen colour when stamped.
+struct st_shape
+{
+	struct st_path
+	{
+		int colour;
+		int width;
+		int style;
+		vector<pair<double,double>> pnts;
+	};
+	vector<st_path> paths;
+};
+
+
+// A shape drawn by STAMP. The paths are moved into place once when stamped
+// and kept as polylines for drawing.
+struct st_stamp
+{
+	shared_ptr<st_shape> shape;
+	vector<st_turtle_polyline> plines;
+
+	st_stamp(
+		shared_ptr<st_shape> &_shape, 
+		double x, double y, double angle, double scale, int col);
+	void draw();
 };
 
 
@@ -742,16 +984,14 @@ struct st_turtle_circle
 	int colour;
 	int style;
 	int line_width;
-	int x_diam;
-	int y_diam;
-	int x;
-	int y;
+	XArc arc;
 	bool fill;
 
 	st_turtle_circle(
 		int col, int sty, int lw,
 		double xdm, double ydm, double _x, double _y, bool fl);
 	void draw();
+	bool sameGC(const st_turtle_circle &circ);
 };
 
 
@@ -773,15 +1013,67 @@ struct st_turtle
 	bool fill_shape;
 	string line_style_str;
 	t_shape draw_lines;
+	unordered_map<st_line_key,size_t,st_line_key_hash> line_index;
+	size_t dead_lines;
+
+	// Stored lines split where they cross the window edges, keyed by
+	// position in draw_lines. Only used in wrap mode and only valid for
+	// the window size they were worked out for.
+	unordered_map<uint32_t,vector<XSegment>> wrap_pieces;
+	int wrap_width;
+	int wrap_height;
+
+	// The turtle is XOR drawn so it can be erased by drawing it again in
+	// the same place without having to redraw everything else
+	bool drawn;
+	bool drawn_fill;
+	int drawn_colour;
+	XPoint drawn_pnts[5];
 
 	// Need seperate groups of fill lines that bound the shapes.
-	// bool = fill yet?, int = colour, t_shape = polygon lines
-	vector<tuple<bool,int,t_shape>> fill_polys;
+	// bool = fill yet?, int = colour, t_shape = polygon lines which are
+	// turned into the XPoint vector when filled
+	vector<tuple<bool,int,t_shape,vector<XPoint>>> fill_polys;
 
 	// int = col, XPoint = x,y
 	vector<pair<int,XPoint>> dots;
 
 	vector<st_turtle_circle> circles;
+	vector<st_turtle_polyline> polylines;
+
+	// Points plotted together. int = colour
+	vector<pair<int,vector<XPoint>>> point_sets;
+
+	vector<st_stamp> stamps;
+	vector<st_turtle_segments> segment_sets;
+
+	// Set while DEFSHAPE is running its commands
+	st_shape *recording;
+
+	// Lines, dots and circles are drawn again rotated round the window
+	// centre this many times in all, and also reflected left to right
+	// if mirror is set. The rotations are stored as cos,sin.
+	int symmetry;
+	bool mirror;
+	vector<pair<double,double>> sym_rots;
+
+	// Every turtle's position and heading stored by field so a group can
+	// be moved in one loop. The current turtle's are in x, y and angle
+	// while it's current. told is the group commands go to, the first
+	// being the current turtle. Pen settings are shared.
+	vector<double> turtles_x;
+	vector<double> turtles_y;
+	vector<double> turtles_angle;
+	vector<uint32_t> told;
+	uint32_t cur_turtle;
+
+	// Everything above in the order it was drawn. The kind says which list
+	// the item is an index into.
+	vector<uint8_t> prim_kinds;
+	vector<uint32_t> prim_items;
+
+	// Number of the above that have been baked into a pixmap and dropped
+	size_t baked_prims;
 
 	st_turtle();
 
@@ -805,15 +1097,46 @@ struct st_turtle
 	void setLineWidth(int width);
 	void setLineStyle(string style);
 	void setFill();
+	void addFillLine(const st_turtle_line &tline);
 	void setSize(int _size);
 	void setTowards(double _x, double _y);
 
 	void drawDot(short dx, short dy);
 	void drawCircle(double x_diam, double y_diam, bool fill);
+	void drawArc(double radius, double degs);
+	void drawPoly(int sides, double len);
+	void drawBezier(double *pnts, int cnt);
+	void movePath(vector<pair<double,double>> &path);
+	void drawPolyline(vector<double> &nums);
+	void plotPoints(vector<double> &nums);
+	void jumpTo(double _x, double _y);
+	void defineShape(string &name, shared_ptr<st_line> &listline);
+	void recordLine(double _x, double _y);
+	void stamp(string &name);
+	void setSymmetry(int n);
+	void setMirror(bool on);
+	int  numCopies();
+	void copyPoint(int copy, double &px, double &py);
+	void transform(vector<double> &m);
+	void lDraw(const string &str, double step, double ang);
+	void newTurtles(int cnt);
+	void tell(vector<double> &ids);
+	void selectTurtle(uint32_t id);
+	void moveTold(int dist);
+	void rotateTold(double ang);
+	void setAngleTold(double ang);
 	void draw();
+	void undraw();
+	void refresh();
 	void drawAll();
+	void drawPrims();
 	void fill();
-	void fillPolygon(int col, t_shape &polygon);
+	void checkMaxPrims();
+	void addPrim(en_prim kind, size_t item);
+	void addDrawLine(st_turtle_line &tline);
+	void drawLine(size_t pos);
+	void indexDrawLine(size_t pos);
+	void compactDrawLines();
 
 	shared_ptr<st_line> facts();
 };
@@ -832,23 +1155,49 @@ struct st_flags
 	unsigned executing:1;
 	unsigned suppress_prompt:1;
 	unsigned angle_in_degs:1;
+	unsigned in_frame:1;
 };
 
 
 struct st_picture
 {
 	string id;
-	XImage *img;
+	Pixmap pixmap; // Kept on the X server
 	int width;
 	int height;
 
-	st_picture(): img(NULL) { }
-	st_picture(char *_id, XImage *_img, int _width, int _height);
+	st_picture(): pixmap(0) { }
+	st_picture(char *_id, Pixmap _pixmap, int _width, int _height);
 	~st_picture();
 	void draw();
 };
 
 
+// A bitmap moved about over the window by itself. It's never drawn into the
+// canvas so moving it only means copying back the canvas where it was. The
+// mask is 0 if the whole rectangle is drawn.
+struct st_sprite
+{
+	Pixmap pixmap;
+	Pixmap mask;
+	GC gc;
+	int width;
+	int height;
+	int hot_x; // Position in the sprite that MOVESPRITE puts at x,y
+	int hot_y;
+	int x; // Top left in the window
+	int y;
+	bool visible;
+
+	st_sprite(st_picture *pic);
+	st_sprite(shared_ptr<st_shape> &shape, double angle, double scale, int col);
+	~st_sprite();
+	void draw(int ax, int ay, int awidth, int aheight);
+	void moveTo(double _x, double _y);
+	void hide();
+};
+
+
 // Arrays
 #ifdef MAINFILE
 const char *error_str[NUM_ERRORS] =
@@ -925,7 +1274,14 @@ const char *error_str[NUM_ERRORS] =
 
 	// 50
 	"Invalid run length type",
-	"Invalid picture"
+	"Invalid picture",
+	"User procedure did not return a value",
+	"Undefined shape",
+	"Cannot do that in a shape definition",
+
+	// 55
+	"L-system string too long",
+	"Undefined sprite"
 };
 
 
@@ -992,7 +1348,11 @@ EXTERN char *xdisp;
 // X
 EXTERN Display *display;
 EXTERN Window win;
-EXTERN GC gc[NUM_COLOURS+1];
+EXTERN GC turtle_gc;
+EXTERN Pixmap canvas; // Copy of everything drawn except the turtle
+EXTERN double refresh_hz;
+EXTERN double frame_rate;
+EXTERN int max_prims;
 EXTERN int img_counter;
 EXTERN int screen;
 EXTERN int win_colour;
@@ -1000,6 +1360,8 @@ EXTERN int x_sock;
 EXTERN st_turtle *turtle; // Can't be created until X initialised
 EXTERN shared_ptr<st_picture> winpic;
 EXTERN map<string,shared_ptr<st_picture>> pictures;
+EXTERN map<string,shared_ptr<st_shape>> shapes;
+EXTERN map<string,shared_ptr<st_sprite>> sprites;
 
 // Runtime
 EXTERN st_flags flags;
@@ -1022,22 +1384,41 @@ EXTERN int tracing_mode;
 
 // xwin.cc
 bool xConnect();
+void xConnectBackground();
+bool xConnecting();
+void xWaitConnect();
 void xDisconnect();
 void xParseEvent();
 void xSetWindowTitle();
 void xSetWindowBackground(int col);
-void xSetLineWidth(int col, int width);
-void xSetLineStyle(int col, int style);
+GC   xGetGC(int col, int width=1, int style=LineSolid);
 void xWindowClear();
+void xCopyCanvas(int x, int y, int width, int height);
+void xFlush(bool force);
+void xSetRefresh(double hz);
+void xBeginFrame();
+void xEndFrame(bool pace);
+void xSetFrameRate(double fps);
+void xSetMaxPrims(int max);
+void xBakeCanvas();
+void xFreeBaked();
 void xWindowMap();
 void xWindowUnmap();
 void xWindowResize(int width, int height, bool force_set=false);
 XImage *xImageCreate(int width, int height);
-void xDrawPoint(int col, int x, int y);
-void xDrawLine(int col, int xf, int yf, int xt, int yt);
-void xDrawLine(int col, double xf, double yf, double xt, double yt);
+void xImageDestroy(XImage *img);
+XImage *xGetImage(Pixmap pixmap, int width, int height);
+Pixmap xPixmapCreate(int width, int height);
+void xPutImage(Pixmap pixmap, XImage *img, int width, int height);
+Pixmap xCopyCanvasToPixmap();
+void xCopyPixmapToCanvas(Pixmap pixmap, int width, int height);
+void xDrawPoints(int col, XPoint *pnts, int cnt);
+void xDrawLine(GC lgc, int xf, int yf, int xt, int yt);
+void xDrawLine(GC lgc, double xf, double yf, double xt, double yt);
 void xDrawPolygon(int col, XPoint *pnts, int cnt, bool fill);
-void xDrawCircle(int col, int x_diam, int y_diam, int x, int y, bool fill);
+void xDrawLines(GC lgc, XPoint *pnts, int cnt);
+void xDrawArcs(GC agc, XArc *arcs, int cnt, bool fill);
+void xDrawTurtle(int col, XPoint *pnts, int cnt, bool fill);
 
 // commands.cc
 size_t comRem(st_line *line, size_t tokpos);
@@ -1068,7 +1449,7 @@ size_t comGo(st_line *line, size_t tokpos);
 size_t comOp(st_line *line, size_t tokpos);
 size_t comGraphics0Args(st_line *line, size_t tokpos);
 size_t comGraphics1Arg(st_line *line, size_t tokpos);
-size_t comGraphics23Args(st_line *line, size_t tokpos);
+size_t comGraphicsNArgs(st_line *line, size_t tokpos);
 size_t comSetInd(st_line *line, size_t tokpos);
 size_t comSave(st_line *line, size_t tokpos);
 size_t comLoad(st_line *line, size_t tokpos);
@@ -1083,6 +1464,11 @@ size_t comSeed(st_line *line, size_t tokpos);
 size_t comAngleMode(st_line *line, size_t tokpos);
 size_t comCT(st_line *line, size_t tokpos);
 size_t comPicture(st_line *line, size_t tokpos);
+size_t comShape(st_line *line, size_t tokpos);
+size_t comLDraw(st_line *line, size_t tokpos);
+size_t comAsk(st_line *line, size_t tokpos);
+size_t comSprite(st_line *line, size_t tokpos);
+size_t comForEach(st_line *line, size_t tokpos);
 
 // procedures.cc
 t_result procEval(st_line *line, size_t tokpos);
@@ -1120,15 +1506,26 @@ t_result procList(st_line *line, size_t tokpos);
 t_result procPath(st_line *line, size_t tokpos);
 t_result procLoadSavePic(st_line *line, size_t tokpos);
 t_result procGetPics(st_line *line, size_t tokpos);
+t_result procMapFilter(st_line *line, size_t tokpos);
+t_result procReduce(st_line *line, size_t tokpos);
+t_result procSort(st_line *line, size_t tokpos);
+t_result procVector(st_line *line, size_t tokpos);
+t_result procRange(st_line *line, size_t tokpos);
+t_result procLSystem(st_line *line, size_t tokpos);
+
+// st_user_proc_inst.cc
+st_user_proc *getUserProc(const string &name);
+st_value runUserProcInst(st_user_proc_inst *inst);
+st_value callUserProc(st_line *line, st_user_proc *proc, vector<st_value> &args);
 
 // proc_files.cc
 void loadProcFile(string filepath, string procname);
 void saveProcFile(string filepath, string &procname, bool psave);
 
 // pictures.cc
-tuple<XImage *,int,int,uint32_t> loadPicFile(string filepath);
-tuple<XImage *,int,int,uint32_t> savePicFile(string filepath);
-st_picture *createPicture(XImage *img, int width, int height);
+tuple<Pixmap,int,int,uint32_t> loadPicFile(string filepath);
+tuple<Pixmap,int,int,uint32_t> savePicFile(string filepath);
+st_picture *createPicture(Pixmap pixmap, int width, int height);
 void setPicture(st_picture *pic);
 
 // vars.cc
@@ -1157,6 +1554,7 @@ void   ready();
 void   prompt();
 void   goodbye();
 void   doExit(int code);
+double getTime();
 
 
 #ifdef MAINFILE
@@ -1247,12 +1645,12 @@ pair<const char *,function<int(st_line *, size_t)>> commands[NUM_COMS] =
 	{ "SETSZ",   comGraphics1Arg },
 	{ "SETLW",   comGraphics1Arg },
 	{ "SETLS",   comGraphics1Arg },
-	{ "SETPOS",  comGraphics23Args },
-	{ "TOWARDS", comGraphics23Args },
+	{ "SETPOS",  comGraphicsNArgs },
+	{ "TOWARDS", comGraphicsNArgs },
 
 	// 60
-	{ "DOT",     comGraphics23Args },
-	{ "CIRC",    comGraphics23Args },
+	{ "DOT",     comGraphicsNArgs },
+	{ "CIRC",    comGraphicsNArgs },
 	{ "WINDOW",  comGraphics0Args },
 	{ "FENCE",   comGraphics0Args },
 	{ "WRAP",    comGraphics0Args },
@@ -1260,7 +1658,7 @@ pair<const char *,function<int(st_line *, size_t)>> commands[NUM_COMS] =
 	// 65
 	{ "SETIND",  comSetInd },
 	{ "SETFILL", comGraphics0Args },
-	{ "SETWINSZ",comGraphics23Args },
+	{ "SETWINSZ",comGraphicsNArgs },
 	{ "FILL",    comGraphics0Args },
 	{ "SAVE",    comSave },
 
@@ -1288,7 +1686,41 @@ pair<const char *,function<int(st_line *, size_t)>> commands[NUM_COMS] =
 	// 85
 	{ "ERPIC",   comPicture },
 	{ "ERPICS",  comErall },
-	{ "SETPIC",  comPicture }
+	{ "SETPIC",  comPicture },
+	{ "FOREACH", comForEach },
+
+	// 90
+	{ "SETREFRESH", comGraphics1Arg },
+	{ "BEGINFRAME", comGraphics0Args },
+	{ "ENDFRAME",   comGraphics0Args },
+	{ "SETFRAMERATE", comGraphics1Arg },
+	{ "SETMAXPRIMS",  comGraphics1Arg },
+
+	// 95
+	{ "ARC",     comGraphicsNArgs },
+	{ "POLY",    comGraphicsNArgs },
+	{ "QBEZIER", comGraphicsNArgs },
+	{ "CBEZIER", comGraphicsNArgs },
+	{ "POLYLINE",comGraphics1Arg },
+
+	// 100
+	{ "PLOTPOINTS", comGraphics1Arg },
+	{ "DEFSHAPE",   comShape },
+	{ "STAMP",      comShape },
+	{ "TRANSFORM",  comGraphics1Arg },
+	{ "SYMMETRY",   comGraphics1Arg },
+
+	// 105
+	{ "MIRROR",     comGraphics0Args },
+	{ "LDRAW",      comLDraw },
+	{ "NEWTURTLE",  comGraphics1Arg },
+	{ "TELL",       comGraphics1Arg },
+	{ "ASK",        comAsk },
+
+	// 110
+	{ "SPRITE",     comSprite },
+	{ "MOVESPRITE", comSprite },
+	{ "HIDESPRITE", comSprite }
 };
 
 // Built in system procedures that take value(s) and return a result. Array 
@@ -1373,7 +1805,29 @@ pair<const char *,function<t_result(st_line *, size_t)>> sysprocs[NUM_SPROCS] =
 	{ "SAVEPIC",procLoadSavePic },
 
 	// 55
-	{ "GETPICS",procGetPics }
+	{ "GETPICS",procGetPics },
+	{ "MAP",    procMapFilter },
+	{ "FILTER", procMapFilter },
+	{ "REDUCE", procReduce },
+
+	// 60
+	{ "SORT",   procSort },
+	{ "VADD",   procVector },
+	{ "VSUB",   procVector },
+	{ "VMUL",   procVector },
+	{ "VDIV",   procVector },
+
+	// 65
+	{ "VMOD",   procVector },
+	{ "VPWR",   procVector },
+	{ "VSCALE", procVector },
+	{ "VSUM",   procVector },
+	{ "VDOT",   procVector },
+
+	// 70
+	{ "RANGE",   procRange },
+	{ "ITERATE", procRange },
+	{ "LSYSTEM", procLSystem }
 };
 #else
 extern pair<const char *,function<int(st_line *, size_t)>> commands[NUM_COMS];
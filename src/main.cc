@@ -156,23 +156,44 @@ void mainloop()
 {
 	t_error err;
 	fd_set mask;
+	timeval tv;
+	timeval *tvp;
 	int rr;
 
 	while(1)
 	{
 		FD_ZERO(&mask);
 		FD_SET(STDIN,&mask);
-		if (flags.graphics_enabled) FD_SET(x_sock,&mask);
+		tvp = NULL;
 
-		switch(select(FD_SETSIZE,&mask,0,0,0))
+		// Don't hold up the prompt waiting for the X server, just check
+		// every so often to see if it's connected yet
+		if (flags.graphics_enabled && xConnecting())
+		{
+			tv = { 0, 50000 };
+			tvp = &tv;
+		}
+		else if (flags.graphics_enabled)
+		{
+			xWaitConnect();
+
+			// Make sure all drawing is visible at the prompt including
+			// any frame left unfinished by an error or STOP
+			if (flags.in_frame) xEndFrame(false);
+			xFlush(true);
+			FD_SET(x_sock,&mask);
+		}
+
+		switch(select(FD_SETSIZE,&mask,0,0,tvp))
 		{
 		case -1:
 			if (errno == EINTR) continue;
 			perror("ERROR: select()");
 			doExit(errno);
 		case 0:
-			// Timeout - should never happen
-			assert(0);
+			// Timeout - only happens while connecting to X
+			assert(tvp);
+			continue;
 		}
 		if (flags.graphics_enabled && FD_ISSET(x_sock,&mask)) xParseEvent();
 
@@ -211,6 +232,9 @@ void init(bool startup)
 	curr_proc_inst = NULL;
 	img_counter = 1;
 	nest_depth = 0;
+	refresh_hz = DEF_REFRESH_HZ;
+	frame_rate = DEF_FRAME_RATE;
+	max_prims = DEF_MAX_PRIMS;
 	srandom(time(0));
 	
 	if (startup)
@@ -218,7 +242,7 @@ void init(bool startup)
 		setSystemVars();
 		if (flags.graphics_enabled)
 		{
-			if (!xConnect()) doExit(1);
+			xConnectBackground();
 		}
 		else turtle = NULL;
 
@@ -255,8 +279,9 @@ void init(bool startup)
 	{
 		try
 		{
-			auto [img,width,height,bytes] = loadPicFile(picfile);
-			setPicture(createPicture(img,width,height));
+			xWaitConnect();
+			auto [pixmap,width,height,bytes] = loadPicFile(picfile);
+			setPicture(createPicture(pixmap,width,height));
 		}
 		catch(t_error &err)
 		{
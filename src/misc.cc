@@ -101,3 +101,14 @@ void doExit(int code)
 	io.kbSaneMode();
 	exit(code);
 }
+
+
+
+
+/*** Monotonic time in seconds for timing intervals ***/
+double getTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + (double)ts.tv_nsec / 1000000000;
+}
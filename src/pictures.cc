@@ -34,7 +34,7 @@ void writeBytes(void *ptr, int size);
 
 //////////////////////////////////// LOAD ////////////////////////////////////
 
-tuple<XImage *,int,int,uint32_t> loadPicFile(string filepath)
+tuple<Pixmap,int,int,uint32_t> loadPicFile(string filepath)
 {
 	string matchpath;
 	en_error err;
@@ -74,10 +74,16 @@ tuple<XImage *,int,int,uint32_t> loadPicFile(string filepath)
 	}
 	catch(en_error err)
 	{
-		XDestroyImage(img);
+		xImageDestroy(img);
 		throw t_error({ err, matchpath });
 	}
-	return { img,hdr.width,hdr.height,bytes };
+
+	// Send it to the server once and keep it there
+	Pixmap pixmap = xPixmapCreate(hdr.width,hdr.height);
+	xPutImage(pixmap,img,hdr.width,hdr.height);
+	xImageDestroy(img);
+
+	return { pixmap,hdr.width,hdr.height,bytes };
 }
 
 
@@ -191,7 +197,7 @@ void readBytes(void *ptr, int size)
 
 //////////////////////////////////// SAVE ////////////////////////////////////
 
-tuple<XImage *,int,int,uint32_t> savePicFile(string filepath)
+tuple<Pixmap,int,int,uint32_t> savePicFile(string filepath)
 {
 	string matchpath;
 	en_error err;
@@ -200,16 +206,28 @@ tuple<XImage *,int,int,uint32_t> savePicFile(string filepath)
 	uint8_t min_rle_type = 0;
 	uint8_t type;
 
-	XImage *img = XGetImage(
-		display,win,
-		0,0,win_width,win_height,AllPlanes,XYPixmap);
+	// Copy the canvas on the server so the turtle isn't included and it
+	// doesn't matter if the window is obscured or unmapped
+	Pixmap pixmap = xCopyCanvasToPixmap();
 
-	// Just create image and leave it at that
-	if (filepath == "") return { img, win_width, win_height, 0 };
+	// Just create picture and leave it at that
+	if (filepath == "") return { pixmap, win_width, win_height, 0 };
 
 	err = matchSavePath(filepath,matchpath,LOGO_PIC_FILE_EXT);
-	if (err != OK) throw t_error({ err, filepath });
-	
+	if (err != OK)
+	{
+		XFreePixmap(display,pixmap);
+		throw t_error({ err, filepath });
+	}
+
+	// Only need the image locally to write it out
+	XImage *img = xGetImage(pixmap,win_width,win_height);
+	if (!img)
+	{
+		XFreePixmap(display,pixmap);
+		throw t_error({ ERR_WRITE_FAIL, matchpath });
+	}
+
 	check_mode = 1;
 	min_bytes = 0;
 
@@ -225,9 +243,19 @@ tuple<XImage *,int,int,uint32_t> savePicFile(string filepath)
 			}
 			hdr.rle_type = type;
 		}
-		else saveHeader(matchpath,min_rle_type);
 
-		bytes = sizeof(hdr) + saveImage(img);
+		// A shared image must be freed or the server keeps the segment
+		try
+		{
+			if (!check_mode) saveHeader(matchpath,min_rle_type);
+			bytes = sizeof(hdr) + saveImage(img);
+		}
+		catch(...)
+		{
+			xImageDestroy(img);
+			XFreePixmap(display,pixmap);
+			throw;
+		}
 		if (!type || bytes < min_bytes)
 		{
 			min_bytes = bytes;
@@ -235,7 +263,8 @@ tuple<XImage *,int,int,uint32_t> savePicFile(string filepath)
 		}
 		if (!check_mode) break;
 	}
-	return { img, win_width, win_height, bytes };
+	xImageDestroy(img);
+	return { pixmap, win_width, win_height, bytes };
 }
 
 
@@ -364,12 +393,12 @@ void writeBytes(void *ptr, int size)
 
 //////////////////////////////////// MISC ////////////////////////////////////
 
-st_picture *createPicture(XImage *img, int width, int height)
+st_picture *createPicture(Pixmap pixmap, int width, int height)
 {
 	char id[30];
 
 	snprintf(id,sizeof(id),"pic_%d",img_counter);
-	st_picture *pic = new st_picture(id,img,width,height);
+	st_picture *pic = new st_picture(id,pixmap,width,height);
 	pictures[id] = shared_ptr<st_picture>(pic);
 	++img_counter;
 	return pic;
@@ -117,6 +117,9 @@ bool st_io::readInput(
 	// broken up between select() calls
 	esc_code = "";
 
+	// Drawing should be visible before waiting for the user
+	if (fd == STDIN && flags.graphics_enabled) xFlush(true);
+
 	// Loop reading the descriptor
 	while(1)
 	{
@@ -36,6 +36,7 @@ st_line::st_line(st_line *rhs)
 	tokens = rhs->tokens;
 	labels = rhs->labels;
 	parent_proc = rhs->parent_proc;
+	range = rhs->range;
 }
 
 
@@ -49,6 +50,7 @@ st_line::st_line(shared_ptr<st_line> &rhs)
 	tokens = rhs->tokens;
 	labels = rhs->labels;
 	parent_proc = rhs->parent_proc;
+	range = rhs->range;
 }
 
 
@@ -592,6 +594,7 @@ void st_line::setLabels()
 /*** Return value only used in st_user_proc::addLine() ***/
 size_t st_line::execute(size_t from)
 {
+	expandRange();
 	if (++nest_depth > MAX_NEST_DEPTH)
 		throw t_error({ ERR_MAX_NEST_DEPTH, "" });
 
@@ -630,6 +633,10 @@ size_t st_line::execute(size_t from)
 				if (tracing_mode)
 					printTrace('C',commands[com].first);
 				pos = commands[com].second(this,pos);
+
+				// Drawing is sent to the X server at most
+				// refresh_hz times a second
+				if (flags.graphics_enabled) xFlush(false);
 				break;
 			default:
 				if (logo_state == STATE_DEF_PROC ||
@@ -848,18 +855,11 @@ t_result st_line::execUserProc(size_t tokpos)
 {
 	string &name = tokens[tokpos].strval;
 	st_user_proc_inst *new_inst;
-	st_user_proc_inst *prev_inst;
 	t_result result;
 
-	// See if proc defined
-	auto mit = user_procs.find(name);
-	if (mit == user_procs.end())
-		throw t_error({ ERR_UNDEFINED_UPROC, name });
-	prev_inst = curr_proc_inst;
-
 	// Don't set curr_proc_inst immediately or local variable lookups for 
 	// current proc (if set) will fail 
-	new_inst = new st_user_proc_inst(mit->second.get());
+	new_inst = new st_user_proc_inst(getUserProc(name));
 
 	// Set parameters
 	try
@@ -871,48 +871,9 @@ t_result st_line::execUserProc(size_t tokpos)
 		delete new_inst;
 		throw;
 	}
-	curr_proc_inst = new_inst;
 
-	// Execute
-	try
-	{
-		curr_proc_inst->execute();
-	}
-	catch(t_error)
-	{
-		if (!stop_proc) stop_proc = curr_proc_inst->proc;
-		delete curr_proc_inst;
-		curr_proc_inst = prev_inst;
-		throw;
-	}
-	catch(t_interrupt &inter)
-	{
-		if (inter.first == INT_RETURN)
-		{
-			assert(curr_proc_inst);
-			if (curr_proc_inst->ret_set)
-			{
-				result = curr_proc_inst->retval;
-				result.second = tokpos;
-				delete curr_proc_inst;
-				curr_proc_inst = prev_inst;
-				return result;
-			}
-			// No result set, just return with empty result
-		}
-		else
-		{
-			if (!stop_proc) stop_proc = curr_proc_inst->proc;
-			delete curr_proc_inst;
-			curr_proc_inst = prev_inst;
-			throw;
-		}
-	}
-
-	delete curr_proc_inst;
-	curr_proc_inst = prev_inst;
-
-	// result.first left unset
+	// result.first left unset if nothing returned
+	result.first = runUserProcInst(new_inst);
 	result.second = tokpos;
 	return result;
 }
@@ -1056,6 +1017,8 @@ bool st_line::operator==(st_line &rhs)
 {
 	assert(type == LINE_LIST && rhs.type == LINE_LIST);
 
+	expandRange();
+	rhs.expandRange();
 	if (tokens.size() != rhs.tokens.size()) return false;
 	size_t pos;
 
@@ -1083,6 +1046,8 @@ void st_line::operator+=(st_line &rhs)
 {
 	assert(type == LINE_LIST && rhs.type == LINE_LIST);
 
+	expandRange();
+	rhs.expandRange();
 	size_t add = tokens.size();
 	for(st_token &tok: rhs.tokens)
 	{
@@ -1104,6 +1069,7 @@ void st_line::operator*=(int cnt)
 {
 	assert(type == LINE_LIST);
 
+	expandRange();
 	if (cnt < 1)	
 	{
 		tokens.clear();
@@ -1145,6 +1111,14 @@ shared_ptr<st_line> st_line::evalList()
 	shared_ptr<st_line> line = make_shared<st_line>(true);
 	t_result result;
 
+	// A range only contains numbers so there's nothing to evaluate
+	if (range)
+	{
+		--nest_depth;
+		line->range = range;
+		return line;
+	}
+
 	try
 	{
 		// Go through our tokens, evaluate any vars and create copies 
@@ -1187,19 +1161,50 @@ shared_ptr<st_line> st_line::evalList()
 void st_line::listShuffle()
 {
 	assert(type == LINE_LIST);
+	expandRange();
 	mt19937_64 ran(time(0));
 	shuffle(tokens.begin(),tokens.end(),ran);
 }
 
+
+
+
+/*** Create the tokens for a range. Only done when something needs to
+     modify or walk the list as a whole ***/
+void st_line::expandRange()
+{
+	if (!range) return;
+
+	assert(tokens.empty());
+	tokens.reserve(range->cnt);
+	for(size_t i=0;i < range->cnt;++i)
+		tokens.emplace_back(st_token(range->element(i)));
+	range.reset();
+}
+
 //////////////////////////////////// GETTERS //////////////////////////////////
 
+/*** Number of elements without expanding a range ***/
+size_t st_line::listSize()
+{
+	assert(type == LINE_LIST);
+	return range ? range->cnt : tokens.size();
+}
+
+
+
+
 /*** Get the particular element from the list. Indexing starts at 1 ***/
 st_value st_line::getListElement(int index)
 {
 	assert(type == LINE_LIST);
 
 	st_value val(0.0);
-	if (index && index <= (int)tokens.size()) val.set(tokens[index-1]);
+	if (index < 1 || index > (int)listSize()) return val;
+	if (range)
+		val.set(range->element(index-1));
+	else
+		val.set(tokens[index-1]);
 	return val;
 }
 
@@ -1213,6 +1218,18 @@ shared_ptr<st_line> st_line::getListPiece(size_t from, size_t to)
 	assert(type == LINE_LIST && (long)from > 0 && (long)to >= (long)from);
 
 	shared_ptr<st_line> line = make_shared<st_line>(true);
+
+	// A piece of a range is just another range
+	if (range)
+	{
+		if (from <= range->cnt)
+		{
+			if (to > range->cnt) to = range->cnt;
+			line->setListRange(
+				range->element(from-1),range->step,to - from + 1);
+		}
+		return line;
+	}
 	if (from <= tokens.size())
 	{
 		if (to > tokens.size()) to = tokens.size();
@@ -1224,6 +1241,32 @@ shared_ptr<st_line> st_line::getListPiece(size_t from, size_t to)
 }
 
 
+
+
+
+/*** Copy a list of numbers into a contiguous array for the vector maths
+     procedures. Anything other than a number is an error. ***/
+void st_line::getListNumbers(vector<double> &nums)
+{
+	assert(type == LINE_LIST);
+
+	if (range)
+	{
+		nums.resize(range->cnt);
+		for(size_t i=0;i < range->cnt;++i) nums[i] = range->element(i);
+		return;
+	}
+	nums.resize(tokens.size());
+	for(size_t i=0;i < tokens.size();++i)
+	{
+		st_token &tok = tokens[i];
+		if (tok.type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, tok.toString() });
+		nums[i] = tok.numval;
+	}
+}
+
+
 ////////////////////////////////// SETTERS ////////////////////////////////////
 
 /*** Create a copy of this->listline except with val prepended ***/
@@ -1231,6 +1274,7 @@ shared_ptr<st_line> st_line::setListFirst(st_value &val)
 {
 	assert(type == LINE_LIST);
 
+	expandRange();
 	shared_ptr<st_line> line = make_shared<st_line>(true);
 	line->tokens.emplace_back(st_token(val));
 	line->tokens.insert(line->tokens.end(),tokens.begin(),tokens.end());
@@ -1246,6 +1290,7 @@ shared_ptr<st_line> st_line::setListLast(st_value &val)
 {
 	assert(type == LINE_LIST);
 
+	expandRange();
 	shared_ptr<st_line> line = make_shared<st_line>(true);
 	line->tokens.insert(line->tokens.end(),tokens.begin(),tokens.end());
 	line->tokens.emplace_back(st_token(val));
@@ -1256,6 +1301,31 @@ shared_ptr<st_line> st_line::setListLast(st_value &val)
 
 
 
+/*** Replace the list contents with the numbers ***/
+void st_line::setListNumbers(vector<double> &nums)
+{
+	assert(type == LINE_LIST);
+
+	tokens.clear();
+	tokens.reserve(nums.size());
+	for(double num: nums) tokens.emplace_back(st_token(num));
+}
+
+
+
+
+/*** Make this an unexpanded range ***/
+void st_line::setListRange(double from, double step, size_t cnt)
+{
+	assert(type == LINE_LIST);
+
+	tokens.clear();
+	range = make_shared<st_range>(from,step,cnt);
+}
+
+
+
+
 /*** Also sets the line number of embedded lines for tracing purposes (TRON)
      Otherwise they'd just report 0 ***/
 void st_line::setLineNum(int _linenum)
@@ -1274,6 +1344,15 @@ size_t st_line::listMemberp(st_value &val)
 	assert(type == LINE_LIST);
 	
 	size_t pos = 0;
+	if (range)
+	{
+		if (val.type != TYPE_NUM) return 0;
+		for(pos=0;pos < range->cnt;++pos)
+		{
+			if (range->element(pos) == val.num) return pos + 1;
+		}
+		return 0;
+	}
 	for(st_token &tok: tokens)
 	{
 		++pos;
@@ -1428,6 +1507,15 @@ string st_line::toString()
 {
 	string outstr;
 
+	if (range)
+	{
+		for(size_t i=0;i < range->cnt;++i)
+		{
+			if (i) outstr += " ";
+			outstr += numToString(range->element(i));
+		}
+		return outstr;
+	}
 	for(st_token &tok: tokens)
 	{
 		if (tok.neg) outstr += "-";
@@ -1484,6 +1572,7 @@ string st_line::toSimpleString()
 	string str;
 	bool space = false;
 
+	if (range) return toString();
 	for(st_token &tok: tokens)
 	{
 		if (space) str += " ";
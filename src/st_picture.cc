@@ -1,9 +1,9 @@
 #include "globals.h"
 
-st_picture::st_picture(char *_id, XImage *_img, int _width, int _height)
+st_picture::st_picture(char *_id, Pixmap _pixmap, int _width, int _height)
 {
 	id = _id;
-	img = _img; 
+	pixmap = _pixmap; 
 	width = _width; 
 	height = _height;
 }
@@ -13,18 +13,14 @@ st_picture::st_picture(char *_id, XImage *_img, int _width, int _height)
 
 st_picture::~st_picture()
 {
-	if (img) XDestroyImage(img);
+	if (pixmap) XFreePixmap(display,pixmap);
 }
 
 
 
+/*** Draws into the canvas. xWindowClear() copies it to the window. This is
+     a copy on the server so nothing is sent. ***/
 void st_picture::draw()
 {
-	if (img)
-	{
-		XPutImage(
-			display,win,gc[COL_WHITE],
-			img,0,0,0,0,width,height);
-        	XFlush(display);
-	}
+	if (pixmap) xCopyPixmapToCanvas(pixmap,width,height);
 }
@@ -0,0 +1,20 @@
+#include "globals.h"
+
+st_range::st_range(double _from, double _step, size_t _cnt)
+{
+	from = _from;
+	step = _step;
+	cnt = _cnt;
+}
+
+
+
+
+/*** Calculate each element from the start rather than accumulating the step
+     so rounding errors don't creep in over long ranges. Indexing starts at 0
+***/
+double st_range::element(size_t index)
+{
+	assert(index < cnt);
+	return from + step * index;
+}
@@ -0,0 +1,164 @@
+#include "globals.h"
+
+/*** A copy of the picture is taken so the sprite is unaffected if the
+     picture is erased. Pictures are rectangles so there's no mask. ***/
+st_sprite::st_sprite(st_picture *pic)
+{
+	width = pic->width;
+	height = pic->height;
+	hot_x = width / 2;
+	hot_y = height / 2;
+	x = y = 0;
+	visible = false;
+	mask = 0;
+	pixmap = xPixmapCreate(width,height);
+	gc = XCreateGC(display,win,0,NULL);
+	XCopyArea(display,pic->pixmap,pixmap,gc,0,0,width,height,0,0);
+}
+
+
+
+
+/*** The shape is drawn as STAMP would draw it with the turtle at the origin,
+     into a pixmap just big enough for it. A 1 bit mask of the lines is drawn
+     at the same time so only they are copied to the window. The hot spot
+     is where the turtle would have been. ***/
+st_sprite::st_sprite(
+	shared_ptr<st_shape> &shape, double angle, double scale, int col)
+{
+	st_stamp stp(shape,0,0,angle,scale,col);
+	int min_x = INT_MAX;
+	int min_y = INT_MAX;
+	int max_x = INT_MIN;
+	int max_y = INT_MIN;
+	int pad = 1;
+
+	for(auto &pline: stp.plines)
+	{
+		pad = max(pad,pline.width / 2 + 1);
+		for(auto &pnt: pline.pnts)
+		{
+			min_x = min(min_x,(int)pnt.x);
+			min_y = min(min_y,(int)pnt.y);
+			max_x = max(max_x,(int)pnt.x);
+			max_y = max(max_y,(int)pnt.y);
+		}
+	}
+	if (min_x > max_x) throw t_error({ ERR_INVALID_ARG, "" });
+
+	hot_x = pad - min_x;
+	hot_y = pad - min_y;
+	width = max_x - min_x + pad * 2 + 1;
+	height = max_y - min_y + pad * 2 + 1;
+	x = y = 0;
+	visible = false;
+	pixmap = xPixmapCreate(width,height);
+	mask = XCreatePixmap(display,win,width,height,1);
+
+	XGCValues gcvals;
+	gcvals.foreground = 0;
+	GC mask_gc = XCreateGC(display,mask,GCForeground,&gcvals);
+	XFillRectangle(display,mask,mask_gc,0,0,width,height);
+	XSetForeground(display,mask_gc,1);
+
+	for(auto &pline: stp.plines)
+	{
+		for(auto &pnt: pline.pnts)
+		{
+			pnt.x += hot_x;
+			pnt.y += hot_y;
+		}
+		XSetLineAttributes(
+			display,mask_gc,pline.width,pline.style,CapButt,JoinMiter);
+		XDrawLines(
+			display,pixmap,xGetGC(pline.colour,pline.width,pline.style),
+			pline.pnts.data(),pline.pnts.size(),CoordModeOrigin);
+		XDrawLines(
+			display,mask,mask_gc,
+			pline.pnts.data(),pline.pnts.size(),CoordModeOrigin);
+	}
+	XFreeGC(display,mask_gc);
+
+	gc = XCreateGC(display,win,0,NULL);
+	XSetClipMask(display,gc,mask);
+}
+
+
+
+
+st_sprite::~st_sprite()
+{
+	XFreeGC(display,gc);
+	XFreePixmap(display,pixmap);
+	if (mask) XFreePixmap(display,mask);
+}
+
+
+
+
+/*** Copy the part of the sprite inside the area to the window. Only drawing
+     that part means sprites outside the area that are above this one
+     aren't drawn over. ***/
+void st_sprite::draw(int ax, int ay, int awidth, int aheight)
+{
+	int x1 = max(x,ax);
+	int y1 = max(y,ay);
+	int x2 = min(x + width,ax + awidth);
+	int y2 = min(y + height,ay + aheight);
+
+	if (x2 <= x1 || y2 <= y1) return;
+	if (mask) XSetClipOrigin(display,gc,x,y);
+	XCopyArea(
+		display,pixmap,win,gc,x1 - x,y1 - y,x2 - x1,y2 - y1,x1,y1);
+}
+
+
+
+
+/*** Put the hot spot at the position. Only the area it left and the area it
+     now covers are copied back from the canvas, which puts back any sprites
+     there too. Inside a frame nothing is done until xEndFrame() copies the
+     whole window. ***/
+void st_sprite::moveTo(double _x, double _y)
+{
+	int old_x = x;
+	int old_y = y;
+	bool was_visible = visible;
+
+	x = (int)round(_x) - hot_x;
+	y = (int)round(_y) - hot_y;
+	visible = true;
+	if (flags.in_frame) return;
+
+	turtle->undraw();
+	if (was_visible &&
+	    old_x < x + width && x < old_x + width &&
+	    old_y < y + height && y < old_y + height)
+	{
+		// Overlapping so do it in one
+		int x1 = min(x,old_x);
+		int y1 = min(y,old_y);
+		xCopyCanvas(
+			x1,y1,max(x,old_x) + width - x1,max(y,old_y) + height - y1);
+	}
+	else
+	{
+		if (was_visible) xCopyCanvas(old_x,old_y,width,height);
+		xCopyCanvas(x,y,width,height);
+	}
+	turtle->draw();
+}
+
+
+
+
+void st_sprite::hide()
+{
+	if (!visible) return;
+	visible = false;
+	if (flags.in_frame) return;
+
+	turtle->undraw();
+	xCopyCanvas(x,y,width,height);
+	turtle->draw();
+}
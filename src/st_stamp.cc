@@ -0,0 +1,31 @@
+#include "globals.h"
+
+/*** Rotate the shape to the heading, scale it and move it to the position.
+     The shape is relative to the turtle heading up so rotating by the
+     heading works the same way as the turtle moving. ***/
+st_stamp::st_stamp(
+	shared_ptr<st_shape> &_shape,
+	double x, double y, double angle, double scale, int col): shape(_shape)
+{
+	double c = cos(angle / DEGS_PER_RADIAN) * scale;
+	double s = sin(angle / DEGS_PER_RADIAN) * scale;
+
+	plines.reserve(shape->paths.size());
+	for(auto &path: shape->paths)
+	{
+		plines.emplace_back(
+			path.colour == -1 ? col : path.colour,path.width,path.style);
+		st_turtle_polyline &pline = plines.back();
+
+		for(auto &[px,py]: path.pnts)
+			pline.addPoint(x + px * c - py * s,y + px * s + py * c);
+	}
+}
+
+
+
+
+void st_stamp::draw()
+{
+	for(auto &pline: plines) pline.draw();
+}
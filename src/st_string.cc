@@ -0,0 +1,249 @@
+#include "globals.h"
+
+static const string empty_str;
+
+st_string::st_string(): off(0), len(0)
+{
+}
+
+
+
+
+st_string::st_string(const string &s)
+{
+	buf = make_shared<const string>(s);
+	off = 0;
+	len = s.size();
+}
+
+
+
+
+st_string::st_string(string &&s)
+{
+	len = s.size();
+	buf = make_shared<const string>(move(s));
+	off = 0;
+}
+
+
+
+
+st_string::st_string(const char *s)
+{
+	buf = make_shared<const string>(s);
+	off = 0;
+	len = buf->size();
+}
+
+
+/////////////////////////////////// ACCESS /////////////////////////////////
+
+size_t st_string::size() const
+{
+	return len;
+}
+
+
+
+
+size_t st_string::length() const
+{
+	return len;
+}
+
+
+
+
+bool st_string::empty() const
+{
+	return !len;
+}
+
+
+
+
+char st_string::operator[](size_t pos) const
+{
+	assert(pos < len);
+	return (*buf)[off + pos];
+}
+
+
+
+
+char st_string::front() const
+{
+	return operator[](0);
+}
+
+
+
+
+char st_string::back() const
+{
+	return operator[](len - 1);
+}
+
+
+
+
+const char *st_string::begin() const
+{
+	return buf ? buf->data() + off : empty_str.data();
+}
+
+
+
+
+const char *st_string::end() const
+{
+	return begin() + len;
+}
+
+
+
+
+size_t st_string::find(const st_string &rhs) const
+{
+	return view().find(rhs.view());
+}
+
+
+
+
+/*** Same as string::substr() except only the view is new ***/
+st_string st_string::substr(size_t pos, size_t cnt) const
+{
+	if (pos > len) throw out_of_range("st_string::substr");
+
+	st_string sub(*this);
+	sub.off += pos;
+	sub.len = min(cnt,len - pos);
+	return sub;
+}
+
+
+
+
+string_view st_string::view() const
+{
+	return buf ? string_view(buf->data() + off,len) : string_view();
+}
+
+
+
+
+/*** If we're only a view of part of the buffer then give ourselves a buffer
+     of our own. Other values sharing the old buffer are unaffected. ***/
+const string &st_string::get() const
+{
+	if (!buf) return empty_str;
+	if (off || len != buf->size())
+	{
+		buf = make_shared<const string>(buf->substr(off,len));
+		off = 0;
+	}
+	return *buf;
+}
+
+
+
+
+/*** A view that runs to the end of the buffer is already nul terminated ***/
+const char *st_string::c_str() const
+{
+	if (buf && off + len == buf->size()) return buf->c_str() + off;
+	return get().c_str();
+}
+
+
+
+
+void st_string::clear()
+{
+	buf.reset();
+	off = 0;
+	len = 0;
+}
+
+
+/////////////////////////////////// OPERATORS ///////////////////////////////
+
+st_string::operator const string&() const
+{
+	return get();
+}
+
+
+
+
+/*** The buffer is shared so appending always creates a new one ***/
+void st_string::operator+=(const st_string &rhs)
+{
+	string s;
+	s.reserve(len + rhs.len);
+	s.append(view());
+	s.append(rhs.view());
+	*this = st_string(move(s));
+}
+
+
+
+
+bool operator==(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() == rhs.view();
+}
+
+
+
+
+bool operator!=(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() != rhs.view();
+}
+
+
+
+
+bool operator<(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() < rhs.view();
+}
+
+
+
+
+bool operator>(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() > rhs.view();
+}
+
+
+
+
+bool operator<=(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() <= rhs.view();
+}
+
+
+
+
+bool operator>=(const st_string &lhs, const st_string &rhs)
+{
+	return lhs.view() >= rhs.view();
+}
+
+
+
+
+string operator+(const st_string &lhs, const st_string &rhs)
+{
+	string s;
+	s.reserve(lhs.len + rhs.len);
+	s.append(lhs.view());
+	s.append(rhs.view());
+	return s;
+}
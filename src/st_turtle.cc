@@ -1,6 +1,5 @@
 #include "globals.h"
 
-#define TURTLE_SIZE 20
 #define SIN(A)      sin((double)(A) / DEGS_PER_RADIAN)
 #define COS(A)      cos((double)(A) / DEGS_PER_RADIAN)
 #define TAN(A)      tan((double)(A) / DEGS_PER_RADIAN)
@@ -8,6 +7,12 @@
 
 st_turtle::st_turtle()
 {
+	drawn = false;
+	recording = NULL;
+	wrap_width = wrap_height = 0;
+	baked_prims = 0;
+	dead_lines = 0;
+	mirror = false;
 	reset();
 }
 
@@ -24,6 +29,16 @@ void st_turtle::reset()
 	fill_shape = false;
 	size = TURTLE_SIZE;
 	win_edge = WIN_UNBOUNDED;
+	setSymmetry(1);
+	setMirror(false);
+
+	// Back to just the one turtle
+	turtles_x.assign(1,0);
+	turtles_y.assign(1,0);
+	turtles_angle.assign(1,0);
+	told.assign(1,0);
+	cur_turtle = 0;
+	setGlobalVarValue("$num_turtles",1);
 	setBackground(WIN_DEFAULT_COL);
 	setLineWidth(1);
 	setLineStyle("SOLID");
@@ -37,11 +52,29 @@ void st_turtle::reset()
 /*** Clear the window and everything drawn but don't reset the turtle ***/
 void st_turtle::clear()
 {
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
 	draw_lines.clear();
+	line_index.clear();
+	wrap_pieces.clear();
+	dead_lines = 0;
 	fill_polys.clear();
 	dots.clear();
 	circles.clear();
+	polylines.clear();
+	point_sets.clear();
+	stamps.clear();
+	segment_sets.clear();
+	prim_kinds.clear();
+	prim_items.clear();
+	if (baked_prims)
+	{
+		baked_prims = 0;
+		setGlobalVarValue("$baked_prims",0);
+	}
+	xFreeBaked();
 	xWindowClear();
+	drawn = false;
 	draw();
 }
 
@@ -55,7 +88,7 @@ void st_turtle::home()
 	angle = 0;
 	prev_x = x;
 	prev_y = y;
-	if (visible) drawAll();
+	refresh();
 }
 
 
@@ -86,6 +119,16 @@ void st_turtle::setXY(double _x, double _y)
 	{
 		throw t_error({ ERR_TURTLE_OUT_OF_BOUNDS, "" });
 	}
+	if (recording)
+	{
+		if (pen_down) recordLine(_x,_y);
+		prev_x = x;
+		prev_y = y;
+		x = _x;
+		y = _y;
+		return;
+	}
+	undraw();
 	prev_x = x;
 	prev_y = y;
 	x = _x;
@@ -97,10 +140,24 @@ void st_turtle::setXY(double _x, double _y)
 		st_turtle_line tline(
 			pen_colour,line_width,line_style,prev_x,prev_y,x,y);
 		tline.draw();
-		draw_lines.emplace_back(tline);
-		if (fill_shape) get<2>(fill_polys.back()).emplace_back(tline);
-
-		XFlush(display);
+		addDrawLine(tline);
+		addFillLine(tline);
+
+		for(int copy=1,copies=numCopies();copy < copies;++copy)
+		{
+			double x1 = prev_x;
+			double y1 = prev_y;
+			double x2 = x;
+			double y2 = y;
+			copyPoint(copy,x1,y1);
+			copyPoint(copy,x2,y2);
+
+			st_turtle_line cline(
+				pen_colour,line_width,line_style,x1,y1,x2,y2);
+			cline.draw();
+			addDrawLine(cline);
+		}
+		checkMaxPrims();
 	}
 
 	// Do this after lines have been drawn or draw routine in st_turtle_line
@@ -114,9 +171,7 @@ void st_turtle::setXY(double _x, double _y)
 		else if (y >= win_height) y -= win_height;
 	}
 
-	// Have to clear window and redraw everything because its the only way
-	// to undraw the turtle at its current position 
-	if (visible) drawAll();
+	draw();
 }
 
 
@@ -145,7 +200,7 @@ void st_turtle::setAngle(double ang)
 		angle = ang;
 		while(angle >= 360) angle -= 360;
 		while(angle < 0) angle += 360;
-		if (visible) drawAll();
+		refresh();
 	}
 }
 
@@ -154,8 +209,9 @@ void st_turtle::setAngle(double ang)
 
 void st_turtle::setVisible(bool vis)
 {
+	undraw();
 	visible = vis;
-	drawAll();
+	draw();
 }
 
 
@@ -165,9 +221,9 @@ void st_turtle::setColour(int col)
 {
 	if (col < 0 || col >= NUM_COLOURS)
 		throw t_error({ ERR_INVALID_COLOUR, "" });
+	undraw();
 	pen_colour = col;
 	draw();
-	XFlush(display);
 }
 
 
@@ -175,11 +231,10 @@ void st_turtle::setColour(int col)
 
 void st_turtle::setPenDown(bool down)
 {
+	// Turtle is filled when the pen is down, an outline when its up
+	undraw();
 	pen_down = down;
-	if (down) 
-		draw();
-	else if (visible)
-		drawAll(); // Turtle is an outline so erase and redraw
+	draw();
 }
 
 
@@ -187,6 +242,7 @@ void st_turtle::setPenDown(bool down)
 
 void st_turtle::setUnbounded()
 {
+	wrap_pieces.clear();
 	puts("Turtle not fenced.");
 	win_edge = WIN_UNBOUNDED;
 }
@@ -196,6 +252,7 @@ void st_turtle::setUnbounded()
 
 void st_turtle::setFence()
 {
+	wrap_pieces.clear();
 	puts("Turtle fenced.");
 	win_edge = WIN_FENCED;
 }
@@ -231,7 +288,9 @@ void st_turtle::setBackground(int col)
 
 void st_turtle::setLineWidth(int width)
 {
-	if (width < 1) throw t_error({ ERR_INVALID_ARG, "" });
+	// Also has to fit in 16 bits for the GC cache key
+	if (width < 1 || width > MAX_LINE_WIDTH)
+		throw t_error({ ERR_INVALID_ARG, to_string(width) });
 	line_width = width;
 }
 
@@ -254,6 +313,8 @@ void st_turtle::setLineStyle(string style)
 
 void st_turtle::setFill()
 {
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
 	// X windows fill algo won't work if polygon is in seperate parts
 	if (win_edge == WIN_WRAPPED) throw t_error({ ERR_CANT_FILL, "" });
 
@@ -265,7 +326,10 @@ void st_turtle::setFill()
 
 	// Add empty vector if not there or have a used one
 	if (!fill_polys.size() || get<2>(fill_polys.back()).size())
-		fill_polys.emplace_back(make_tuple(false,pen_colour,t_shape()));
+	{
+		fill_polys.emplace_back(
+			make_tuple(false,pen_colour,t_shape(),vector<XPoint>()));
+	}
 }
 
 
@@ -275,7 +339,7 @@ void st_turtle::setSize(int _size)
 {
 	if (_size < 0) throw t_error({ ERR_INVALID_ARG, "" });
 	size = _size;
-	if (visible) drawAll();
+	refresh();
 }
 
 
@@ -298,7 +362,7 @@ void st_turtle::setTowards(double _x, double _y)
 		else 
 		if (xd < 0) angle += 360;
 	}
-	if (visible) drawAll();
+	refresh();
 }
 
 
@@ -309,9 +373,21 @@ void st_turtle::setTowards(double _x, double _y)
      move but simpler to put it here for redraw purposes ***/
 void st_turtle::drawDot(short dx, short dy)
 {
-	xDrawPoint(pen_colour,dx,dy);
-	dots.emplace_back(make_pair(pen_colour,XPoint{dx,dy}));
-	XFlush(display);
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
+	undraw();
+	for(int copy=0,copies=numCopies();copy < copies;++copy)
+	{
+		double px = dx;
+		double py = dy;
+		copyPoint(copy,px,py);
+		dots.emplace_back(
+			make_pair(pen_colour,XPoint{(short)round(px),(short)round(py)}));
+		xDrawPoints(pen_colour,&dots.back().second,1);
+		addPrim(PRIM_DOT,dots.size() - 1);
+	}
+	checkMaxPrims();
+	draw();
 }
 
 
@@ -319,21 +395,35 @@ void st_turtle::drawDot(short dx, short dy)
 
 void st_turtle::drawCircle(double x_diam, double y_diam, bool fill)
 {
-	st_turtle_circle circ(
-		pen_colour,line_style,line_width,x_diam,y_diam,x,y,fill);
-	circles.emplace_back(circ);
-	circ.draw();
-	XFlush(display);
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
+	undraw();
+	for(int copy=0,copies=numCopies();copy < copies;++copy)
+	{
+		double px = x;
+		double py = y;
+		copyPoint(copy,px,py);
+
+		st_turtle_circle circ(
+			pen_colour,line_style,line_width,x_diam,y_diam,px,py,fill);
+		circles.emplace_back(circ);
+		addPrim(PRIM_CIRCLE,circles.size() - 1);
+		circ.draw();
+	}
+	checkMaxPrims();
+	draw();
 }
 
 
 
 
-/*** Draw the turtle itself which is an arrow shape ***/
+/*** Draw the turtle itself which is an arrow shape. It is XOR drawn so
+     undraw() must be called before anything else is drawn underneath it
+     and before it moves. ***/
 void st_turtle::draw()
 {
-	if (!visible) return;
-	XPoint pnt[5];
+	if (!visible || drawn || recording) return;
+	XPoint *pnt = drawn_pnts;
 
 	pnt[0].x = (int)roundf(x + SIN(angle) * size);
 	pnt[0].y = (int)roundf(y - COS(angle) * size);
@@ -346,39 +436,978 @@ void st_turtle::draw()
 	pnt[4].x = pnt[0].x;
 	pnt[4].y = pnt[0].y;
 
-	if (line_width != 1) xSetLineWidth(pen_colour,1);
-	xDrawPolygon(pen_colour,pnt,5,pen_down);
-	if (line_width != 1) xSetLineWidth(pen_colour,line_width);
+	drawn_colour = pen_colour;
+	drawn_fill = pen_down;
+	drawn = true;
+	xDrawTurtle(drawn_colour,drawn_pnts,5,drawn_fill);
+}
+
+
+
+
+/*** Erase the turtle by XOR drawing it again exactly as it was drawn ***/
+void st_turtle::undraw()
+{
+	if (!drawn) return;
+	xDrawTurtle(drawn_colour,drawn_pnts,5,drawn_fill);
+	drawn = false;
+}
+
+
+
+
+/*** Move the turtle image to the turtles current position and angle ***/
+void st_turtle::refresh()
+{
+	undraw();
+	draw();
+}
+
+
+
+
+/*** Move the turtle along an arc of the given radius turning through the 
+     given number of degrees, right if positive, left if negative. The 
+     centre is that far to the right or left of the turtle. ***/
+void st_turtle::drawArc(double radius, double degs)
+{
+	if (radius < 0) throw t_error({ ERR_INVALID_ARG, numToString(radius) });
+
+	vector<pair<double,double>> path;
+	double sgn = SGN(degs);
+	double cx = x + sgn * radius * COS(angle);
+	double cy = y + sgn * radius * SIN(angle);
+
+	// A point every 5 degrees or 4 pixels, whichever is more
+	int cnt = (int)ceil(min(max(
+		fabs(degs) / 5,fabs(degs) / DEGS_PER_RADIAN * radius / 4),10000.0));
+
+	for(int i=1;i <= cnt;++i)
+	{
+		double ang = angle + degs * i / cnt;
+		path.push_back({ 
+			cx - sgn * radius * COS(ang), cy - sgn * radius * SIN(ang) });
+	}
+	movePath(path);
+	setAngle(angle + degs);
+}
+
+
+
+
+/*** Same as REPEAT <sides> [FD <len> RT 360 / <sides>] ***/
+void st_turtle::drawPoly(int sides, double len)
+{
+	if (sides < 1 || sides > MAX_POLY_SIDES)
+		throw t_error({ ERR_INVALID_ARG, numToString(sides) });
+
+	vector<pair<double,double>> path;
+	double px = x;
+	double py = y;
+
+	for(int i=0;i < sides;++i)
+	{
+		double ang = angle + 360.0 * i / sides;
+		px += SIN(ang) * len;
+		py -= COS(ang) * len;
+		path.push_back({ px, py });
+	}
+	movePath(path);
+}
+
 
-	XFlush(display);
+
+
+/*** Quadratic if there are 4 numbers (control point and end), cubic if 6
+     (2 control points and end). Afterwards the turtle heads along the curve
+     as it was at the end. ***/
+void st_turtle::drawBezier(double *pnts, int cnt)
+{
+	vector<pair<double,double>> path;
+	double len = 0;
+	double px = x;
+	double py = y;
+	int steps;
+
+	// Split it up according to the length of the control polygon
+	for(int i=0;i < cnt;i += 2)
+	{
+		len += hypot(pnts[i] - px,pnts[i+1] - py);
+		px = pnts[i];
+		py = pnts[i+1];
+	}
+	steps = min(max((int)ceil(len / 4),4),1000);
+
+	for(int i=1;i <= steps;++i)
+	{
+		double t = (double)i / steps;
+		double u = 1 - t;
+
+		if (cnt == 4)
+		{
+			path.push_back({
+				u*u*x + 2*u*t*pnts[0] + t*t*pnts[2],
+				u*u*y + 2*u*t*pnts[1] + t*t*pnts[3] });
+		}
+		else
+		{
+			path.push_back({
+				u*u*u*x + 3*u*u*t*pnts[0] + 3*u*t*t*pnts[2] + t*t*t*pnts[4],
+				u*u*u*y + 3*u*u*t*pnts[1] + 3*u*t*t*pnts[3] + t*t*t*pnts[5] });
+		}
+	}
+
+	// The end direction is from the last control point unless it's at the
+	// end in which case use the one before
+	double ex = pnts[cnt-2];
+	double ey = pnts[cnt-1];
+	double dx = ex - pnts[cnt-4];
+	double dy = ey - pnts[cnt-3];
+	if (!dx && !dy)
+	{
+		dx = ex - (cnt == 4 ? x : pnts[0]);
+		dy = ey - (cnt == 4 ? y : pnts[1]);
+	}
+	movePath(path);
+	if (dx || dy) setTowards(x + dx,y + dy);
 }
 
 
 
 
-/*** Draw all lines plus the turtle. Have to do this simply to properly erase
-     the turtle as GXor in a GC doesn't bloody work ***/
+/*** Move the turtle through the points, stored as a single polyline rather
+     than a line per step. In wrap mode each step has to go through setXY()
+     so the lines get split at the window edges. ***/
+void st_turtle::movePath(vector<pair<double,double>> &path)
+{
+	if (path.empty()) return;
+	if (!pen_down)
+	{
+		setXY(path.back().first,path.back().second);
+		return;
+	}
+	if (win_edge == WIN_WRAPPED || recording)
+	{
+		for(auto &[px,py]: path) setXY(px,py);
+		return;
+	}
+	if (win_edge == WIN_FENCED)
+	{
+		for(auto &[px,py]: path)
+		{
+			if (px < 0 || py < 0 || px >= win_width || py >= win_height)
+				throw t_error({ ERR_TURTLE_OUT_OF_BOUNDS, "" });
+		}
+	}
+
+	// Any symmetry copies are polylines too
+	int copies = numCopies();
+	vector<st_turtle_polyline> plines(
+		copies,st_turtle_polyline(pen_colour,line_width,line_style));
+
+	auto addPoint = [&](double px, double py)
+	{
+		for(int copy=0;copy < copies;++copy)
+		{
+			double cx = px;
+			double cy = py;
+			copyPoint(copy,cx,cy);
+			plines[copy].addPoint(cx,cy);
+		}
+	};
+	addPoint(x,y);
+
+	for(auto &[px,py]: path)
+	{
+		addPoint(px,py);
+		prev_x = x;
+		prev_y = y;
+		x = px;
+		y = py;
+
+		// The polygon is made of lines so FILL works as usual
+		addFillLine(st_turtle_line(
+			pen_colour,line_width,line_style,prev_x,prev_y,x,y));
+	}
+
+	// Might not have gone anywhere
+	if (plines[0].pnts.size() < 2)
+	{
+		refresh();
+		return;
+	}
+
+	undraw();
+	for(auto &pline: plines)
+	{
+		pline.draw();
+		polylines.emplace_back(std::move(pline));
+		addPrim(PRIM_POLYLINE,polylines.size() - 1);
+	}
+	checkMaxPrims();
+	draw();
+}
+
+
+
+
+/*** Draw lines joining the x,y pairs. Unlike the other shapes this starts
+     from the first point rather than where the turtle is. ***/
+void st_turtle::drawPolyline(vector<double> &nums)
+{
+	vector<pair<double,double>> path;
+
+	path.reserve(nums.size() / 2);
+	for(size_t i=2;i < nums.size();i += 2)
+		path.push_back({ nums[i], nums[i+1] });
+
+	jumpTo(nums[0],nums[1]);
+	movePath(path);
+}
+
+
+
+
+/*** Draw a dot at each of the x,y pairs and leave the turtle on the last.
+     They're stored together and drawn with one request. ***/
+void st_turtle::plotPoints(vector<double> &nums)
+{
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
+	// When fenced nothing is drawn if any point is out of bounds
+	if (win_edge == WIN_FENCED)
+	{
+		for(size_t i=0;i < nums.size();i += 2)
+		{
+			if (nums[i] < 0 || nums[i+1] < 0 ||
+			    nums[i] >= win_width || nums[i+1] >= win_height)
+			{
+				throw t_error({ ERR_TURTLE_OUT_OF_BOUNDS, "" });
+			}
+		}
+	}
+
+	vector<XPoint> pnts;
+	int copies = numCopies();
+
+	pnts.reserve(nums.size() / 2 * copies);
+	for(int copy=0;copy < copies;++copy)
+	{
+		for(size_t i=0;i < nums.size();i += 2)
+		{
+			double px = nums[i];
+			double py = nums[i+1];
+			copyPoint(copy,px,py);
+			pnts.push_back({ (short)round(px), (short)round(py) });
+		}
+	}
+
+	jumpTo(nums[nums.size()-2],nums.back());
+
+	undraw();
+	xDrawPoints(pen_colour,pnts.data(),pnts.size());
+	point_sets.emplace_back(pen_colour,std::move(pnts));
+	addPrim(PRIM_POINTS,point_sets.size() - 1);
+	checkMaxPrims();
+	draw();
+}
+
+
+
+
+/*** Run the commands with the turtle at 0,0 heading up and record the lines
+     drawn rather than drawing them. The pen colour is -1 to start with so
+     that lines not drawn in a set colour are stamped in the pen colour at
+     the time. Afterwards the turtle is put back as it was. ***/
+void st_turtle::defineShape(string &name, shared_ptr<st_line> &listline)
+{
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "DEFSHAPE" });
+
+	shared_ptr<st_shape> shape = make_shared<st_shape>();
+	double save_x = x;
+	double save_y = y;
+	double save_prev_x = prev_x;
+	double save_prev_y = prev_y;
+	double save_angle = angle;
+	int save_colour = pen_colour;
+	int save_width = line_width;
+	int save_style = line_style;
+	int save_edge = win_edge;
+	string save_style_str = line_style_str;
+	bool save_pen_down = pen_down;
+	bool save_visible = visible;
+
+	undraw();
+	x = y = prev_x = prev_y = angle = 0;
+	pen_colour = -1;
+	pen_down = true;
+	win_edge = WIN_UNBOUNDED;
+	recording = shape.get();
+
+	auto restore = [&]()
+	{
+		recording = NULL;
+		x = save_x;
+		y = save_y;
+		prev_x = save_prev_x;
+		prev_y = save_prev_y;
+		angle = save_angle;
+		pen_colour = save_colour;
+		line_width = save_width;
+		line_style = save_style;
+		line_style_str = save_style_str;
+		win_edge = save_edge;
+		pen_down = save_pen_down;
+		visible = save_visible;
+		draw();
+	};
+
+	try
+	{
+		listline->execute();
+	}
+	catch(t_interrupt &inter)
+	{
+		// As with REPEAT a STOP only stops the definition
+		if (inter.first != INT_STOP)
+		{
+			restore();
+			throw;
+		}
+	}
+	catch(...)
+	{
+		restore();
+		throw;
+	}
+	restore();
+	shapes[name] = shape;
+}
+
+
+
+
+/*** Lines carrying on from the end of the last path with the same colour,
+     width and style are added to it ***/
+void st_turtle::recordLine(double _x, double _y)
+{
+	auto &paths = recording->paths;
+
+	if (paths.empty() ||
+	    paths.back().colour != pen_colour ||
+	    paths.back().width != line_width ||
+	    paths.back().style != line_style ||
+	    paths.back().pnts.back() != make_pair(x,y))
+	{
+		paths.push_back({ pen_colour, line_width, line_style, { { x, y } } });
+	}
+	paths.back().pnts.push_back({ _x, _y });
+}
+
+
+
+
+/*** Draw the shape at the turtle's position and heading, scaled by the size
+     of the turtle relative to its default. Inside DEFSHAPE it's added to the
+     shape being defined instead. ***/
+void st_turtle::stamp(string &name)
+{
+	auto it = shapes.find(name);
+	if (it == shapes.end()) throw t_error({ ERR_UNDEFINED_SHAPE, name });
+
+	st_stamp stp(it->second,x,y,angle,size / TURTLE_SIZE,pen_colour);
+
+	if (recording)
+	{
+		// Stamping a shape inside itself would change it while using it
+		if (recording == it->second.get())
+			throw t_error({ ERR_CANT_IN_SHAPE, name });
+
+		// Need the unrounded points so do it again here rather than use
+		// the stamp's polylines
+		double c = COS(angle) * size / TURTLE_SIZE;
+		double s = SIN(angle) * size / TURTLE_SIZE;
+		for(auto &path: it->second->paths)
+		{
+			st_shape::st_path newpath = 
+			{
+				path.colour == -1 ? pen_colour : path.colour,
+				path.width,
+				path.style,
+				{ }
+			};
+			for(auto &[px,py]: path.pnts)
+			{
+				newpath.pnts.push_back(
+					{ x + px * c - py * s, y + px * s + py * c });
+			}
+			recording->paths.emplace_back(std::move(newpath));
+		}
+		return;
+	}
+
+	undraw();
+	stamps.emplace_back(std::move(stp));
+	stamps.back().draw();
+	addPrim(PRIM_STAMP,stamps.size() - 1);
+	checkMaxPrims();
+	draw();
+}
+
+
+
+
+/*** 1 means no copies ***/
+void st_turtle::setSymmetry(int n)
+{
+	if (n < 1) throw t_error({ ERR_INVALID_ARG, to_string(n) });
+
+	symmetry = n;
+	sym_rots.resize(n);
+	for(int i=0;i < n;++i)
+	{
+		double ang = 360.0 * i / n;
+		sym_rots[i] = { COS(ang), SIN(ang) };
+	}
+	setGlobalVarValue("$symmetry",symmetry);
+}
+
+
+
+
+void st_turtle::setMirror(bool on)
+{
+	mirror = on;
+	setGlobalVarValue("$mirror",mirror);
+}
+
+
+
+
+/*** Number of times each thing is drawn including the original ***/
+int st_turtle::numCopies()
+{
+	return symmetry * (mirror ? 2 : 1);
+}
+
+
+
+
+/*** Copy 0 is the original, then the rotations, then the same again
+     reflected in the vertical line through the centre of the window ***/
+void st_turtle::copyPoint(int copy, double &px, double &py)
+{
+	if (!copy) return;
+
+	double cx = (double)win_width / 2;
+	double cy = (double)win_height / 2;
+	double dx = px - cx;
+	double dy = py - cy;
+
+	if (copy >= symmetry)
+	{
+		dx = -dx;
+		copy -= symmetry;
+	}
+	auto [c,s] = sym_rots[copy];
+	px = cx + dx * c - dy * s;
+	py = cy + dx * s + dy * c;
+}
+
+
+
+
+/*** Apply the matrix [a b c d e f] to everything drawn so far with the 
+     window centre as the origin so x' = ax + cy + e and y' = bx + dy + f. 
+     Circles are kept upright so they become the ellipse fitting round where
+     the circle would go. The turtle isn't moved and anything already baked
+     into a pixmap can't be changed. ***/
+void st_turtle::transform(vector<double> &m)
+{
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
+	double cx = (double)win_width / 2;
+	double cy = (double)win_height / 2;
+
+	auto tpoint = [&](double &px, double &py)
+	{
+		double dx = px - cx;
+		double dy = py - cy;
+		px = cx + m[0] * dx + m[2] * dy + m[4];
+		py = cy + m[1] * dx + m[3] * dy + m[5];
+	};
+	auto txpoint = [&](XPoint &pnt)
+	{
+		double px = pnt.x;
+		double py = pnt.y;
+		tpoint(px,py);
+		pnt.x = (short)round(px);
+		pnt.y = (short)round(py);
+	};
+	auto tline = [&](st_turtle_line &tl)
+	{
+		txpoint(tl.from);
+		txpoint(tl.to);
+	};
+
+	for(auto &tl: draw_lines) tline(tl);
+
+	// The keys have changed
+	compactDrawLines();
+
+	for(auto &[filled,col,shape,poly_pnts]: fill_polys)
+	{
+		for(auto &tl: shape) tline(tl);
+		for(auto &pnt: poly_pnts) txpoint(pnt);
+	}
+	for(auto &[col,pnt]: dots) txpoint(pnt);
+
+	for(auto &circ: circles)
+	{
+		double rx = (double)circ.arc.width / 2;
+		double ry = (double)circ.arc.height / 2;
+		double px = circ.arc.x + rx;
+		double py = circ.arc.y + ry;
+		tpoint(px,py);
+
+		double nrx = hypot(m[0] * rx,m[2] * ry);
+		double nry = hypot(m[1] * rx,m[3] * ry);
+		circ.arc.x = (short)round(px - nrx);
+		circ.arc.y = (short)round(py - nry);
+		circ.arc.width = (unsigned short)round(nrx * 2);
+		circ.arc.height = (unsigned short)round(nry * 2);
+	}
+	for(auto &pline: polylines)
+		for(auto &pnt: pline.pnts) txpoint(pnt);
+
+	for(auto &[col,pnts]: point_sets)
+		for(auto &pnt: pnts) txpoint(pnt);
+
+	for(auto &stp: stamps)
+	{
+		for(auto &pline: stp.plines)
+			for(auto &pnt: pline.pnts) txpoint(pnt);
+	}
+	for(auto &set: segment_sets)
+	{
+		for(auto &seg: set.segs)
+		{
+			XPoint from = { seg.x1, seg.y1 };
+			XPoint to = { seg.x2, seg.y2 };
+			txpoint(from);
+			txpoint(to);
+			seg = { from.x, from.y, to.x, to.y };
+		}
+	}
+	drawAll();
+}
+
+
+
+
+/*** Interpret an L-system string. F and G move forward drawing, f moves
+     forward without, + and - turn left and right, | turns round and [ and ]
+     push and pop the position and heading. Anything else is ignored. Each
+     run of drawing moves is one polyline through movePath(). ***/
+void st_turtle::lDraw(const string &str, double step, double ang)
+{
+	vector<tuple<double,double,double>> stack;
+	vector<pair<double,double>> path;
+	double lx = x;
+	double ly = y;
+	double la = angle;
+
+	// In wrap mode the turtle is put back in the window after each step
+	// so the next one has to start from where it really is
+	auto flush = [&]()
+	{
+		if (path.empty()) return;
+		movePath(path);
+		path.clear();
+		lx = x;
+		ly = y;
+	};
+
+	for(char c: str)
+	{
+		if (flags.do_break)
+		{
+			flush();
+			setAngle(la);
+			throw t_interrupt({ INT_BREAK, "" });
+		}
+		switch(c)
+		{
+		case 'F':
+		case 'G':
+			lx += SIN(la) * step;
+			ly -= COS(la) * step;
+			path.push_back({ lx, ly });
+			if (win_edge == WIN_WRAPPED) flush();
+			break;
+		case 'f':
+			flush();
+			lx += SIN(la) * step;
+			ly -= COS(la) * step;
+			jumpTo(lx,ly);
+			break;
+		case '+':
+			la -= ang;
+			break;
+		case '-':
+			la += ang;
+			break;
+		case '|':
+			la += 180;
+			break;
+		case '[':
+			stack.push_back({ lx, ly, la });
+			break;
+		case ']':
+			if (stack.empty()) break;
+			flush();
+			tie(lx,ly,la) = stack.back();
+			stack.pop_back();
+			jumpTo(lx,ly);
+			break;
+		}
+	}
+	flush();
+	setAngle(la);
+}
+
+
+
+
+////////////////////////////// MULTIPLE TURTLES //////////////////////////////
+
+/*** New turtles start at home ***/
+void st_turtle::newTurtles(int cnt)
+{
+	if (cnt < 1) throw t_error({ ERR_INVALID_ARG, to_string(cnt) });
+
+	size_t num = turtles_x.size() + cnt;
+	if (num > MAX_TURTLES) throw t_error({ ERR_INVALID_ARG, to_string(cnt) });
+
+	turtles_x.resize(num,(double)win_width / 2);
+	turtles_y.resize(num,(double)win_height / 2);
+	turtles_angle.resize(num,0);
+	setGlobalVarValue("$num_turtles",(double)num);
+}
+
+
+
+
+/*** Set the group that commands go to. The first becomes the current turtle
+     which is the one shown and the one used by all commands other than 
+     FD, BK, LT, RT and SETH. ***/
+void st_turtle::tell(vector<double> &ids)
+{
+	// Would swap the definition's position into the other turtles
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+	if (ids.empty()) throw t_error({ ERR_INVALID_ARG, "" });
+
+	vector<uint32_t> new_told(ids.size());
+
+	for(size_t i=0;i < ids.size();++i)
+	{
+		if (ids[i] < 0 || ids[i] >= turtles_x.size() || ids[i] != (int)ids[i])
+			throw t_error({ ERR_INVALID_ARG, numToString(ids[i]) });
+		new_told[i] = (uint32_t)ids[i];
+	}
+	told.swap(new_told);
+	selectTurtle(told[0]);
+}
+
+
+
+
+void st_turtle::selectTurtle(uint32_t id)
+{
+	if (id == cur_turtle) return;
+
+	undraw();
+	turtles_x[cur_turtle] = x;
+	turtles_y[cur_turtle] = y;
+	turtles_angle[cur_turtle] = angle;
+
+	cur_turtle = id;
+	x = prev_x = turtles_x[id];
+	y = prev_y = turtles_y[id];
+	angle = turtles_angle[id];
+	draw();
+}
+
+
+
+
+/*** Move all the told turtles in one pass. Their lines go into one set of
+     segments which is sent to the server together. If any turtle would go
+     out of bounds when fenced then none of them move. Only the current
+     turtle's line goes into a polygon being built for FILL, the same as
+     when it moves on its own. ***/
+void st_turtle::moveTold(int dist)
+{
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
+	static vector<double> new_x;
+	static vector<double> new_y;
+	size_t cnt = told.size();
+
+	turtles_x[cur_turtle] = x;
+	turtles_y[cur_turtle] = y;
+	turtles_angle[cur_turtle] = angle;
+
+	new_x.resize(cnt);
+	new_y.resize(cnt);
+	for(size_t i=0;i < cnt;++i)
+	{
+		uint32_t id = told[i];
+		double ang = turtles_angle[id];
+		new_x[i] = turtles_x[id] + SIN(ang) * dist;
+		new_y[i] = turtles_y[id] - COS(ang) * dist;
+	}
+
+	if (win_edge == WIN_FENCED)
+	{
+		for(size_t i=0;i < cnt;++i)
+		{
+			if (new_x[i] < 0 || new_y[i] < 0 || 
+			    new_x[i] >= win_width || new_y[i] >= win_height)
+			{
+				throw t_error({ ERR_TURTLE_OUT_OF_BOUNDS, "" });
+			}
+		}
+	}
+
+	undraw();
+	if (pen_down)
+	{
+		st_turtle_segments set(pen_colour,line_width,line_style);
+		int copies = numCopies();
+
+		set.segs.reserve(cnt * copies);
+		for(size_t i=0;i < cnt;++i)
+		{
+			uint32_t id = told[i];
+
+			if (id == cur_turtle)
+			{
+				addFillLine(st_turtle_line(
+					pen_colour,line_width,line_style,
+					turtles_x[id],turtles_y[id],new_x[i],new_y[i]));
+			}
+			for(int copy=0;copy < copies;++copy)
+			{
+				double x1 = turtles_x[id];
+				double y1 = turtles_y[id];
+				double x2 = new_x[i];
+				double y2 = new_y[i];
+				copyPoint(copy,x1,y1);
+				copyPoint(copy,x2,y2);
+
+				if (win_edge == WIN_WRAPPED)
+				{
+					static vector<XSegment> pieces;
+					st_turtle_line tline(
+						pen_colour,line_width,line_style,x1,y1,x2,y2);
+					tline.getWrapPieces(pieces);
+					set.segs.insert(
+						set.segs.end(),pieces.begin(),pieces.end());
+				}
+				else set.addSegment(x1,y1,x2,y2);
+			}
+		}
+		set.draw();
+		segment_sets.emplace_back(std::move(set));
+		addPrim(PRIM_SEGMENTS,segment_sets.size() - 1);
+		checkMaxPrims();
+	}
+
+	for(size_t i=0;i < cnt;++i)
+	{
+		uint32_t id = told[i];
+		double nx = new_x[i];
+		double ny = new_y[i];
+
+		if (win_edge == WIN_WRAPPED)
+		{
+			if (nx < 0) nx += win_width;
+			else if (nx >= win_width) nx -= win_width;
+
+			if (ny < 0) ny += win_height;
+			else if (ny >= win_height) ny -= win_height;
+		}
+		turtles_x[id] = nx;
+		turtles_y[id] = ny;
+	}
+
+	prev_x = x;
+	prev_y = y;
+	x = turtles_x[cur_turtle];
+	y = turtles_y[cur_turtle];
+	draw();
+}
+
+
+
+
+void st_turtle::rotateTold(double ang)
+{
+	turtles_angle[cur_turtle] = angle;
+	for(uint32_t id: told)
+	{
+		double &tang = turtles_angle[id];
+		tang = fmod(tang + ang,360);
+		if (tang < 0) tang += 360;
+	}
+	setAngle(turtles_angle[cur_turtle]);
+}
+
+
+
+
+void st_turtle::setAngleTold(double ang)
+{
+	ang = fmod(ang,360);
+	if (ang < 0) ang += 360;
+	for(uint32_t id: told) turtles_angle[id] = ang;
+	setAngle(ang);
+}
+
+
+
+
+/*** Move without drawing whatever the pen state ***/
+void st_turtle::jumpTo(double _x, double _y)
+{
+	bool down = pen_down;
+
+	pen_down = false;
+	try
+	{
+		setXY(_x,_y);
+	}
+	catch(...)
+	{
+		pen_down = down;
+		throw;
+	}
+	pen_down = down;
+}
+
+
+
+
+/*** Draw everything plus the turtle. Only needed when the window has been
+     cleared or resized as the turtle itself is erased with undraw(). Anything
+     baked is put back by xWindowClear(). ***/
 void st_turtle::drawAll()
 {
 	xWindowClear();
+	drawn = false;
+	drawPrims();
+	draw();
+}
 
-	// Draw all the lines
-	for(auto &tline: draw_lines) tline.draw();
 
-	// Draw any filled polygons
-	for(auto &[fill,col,shape]: fill_polys)
-		if (fill) fillPolygon(col,shape);
 
-	// Draw dots
-	for(auto &[col,coord]: dots) xDrawPoint(col,coord.x,coord.y);
 
-	// Draw circles
-	for(auto &circ: circles) circ.draw();
+/*** Draw the stored things in the order they were originally drawn. Runs of
+     dots or circles that use the same GC are sent in one go, as are lines by
+     xDrawLine(). ***/
+void st_turtle::drawPrims()
+{
+	static vector<XPoint> pnts;
+	static vector<XArc> arcs;
+	size_t cnt = prim_kinds.size();
+	size_t i;
+
+	for(i=0;i < cnt;)
+	{
+		uint32_t item = prim_items[i];
+
+		switch(prim_kinds[i])
+		{
+		case PRIM_LINE:
+			if (draw_lines[item].colour != -1) drawLine(item);
+			++i;
+			break;
+
+		case PRIM_DOT:
+		{
+			int col = dots[item].first;
+			pnts.clear();
+			for(;i < cnt && 
+			     prim_kinds[i] == PRIM_DOT && 
+			     dots[prim_items[i]].first == col;++i)
+			{
+				pnts.push_back(dots[prim_items[i]].second);
+			}
+			xDrawPoints(col,pnts.data(),pnts.size());
+			break;
+		}
+
+		case PRIM_CIRCLE:
+		{
+			st_turtle_circle &circ = circles[item];
+			arcs.clear();
+			for(;i < cnt && 
+			     prim_kinds[i] == PRIM_CIRCLE &&
+			     circles[prim_items[i]].sameGC(circ);++i)
+			{
+				arcs.push_back(circles[prim_items[i]].arc);
+			}
+			xDrawArcs(
+				xGetGC(circ.colour,circ.line_width,circ.style),
+				arcs.data(),arcs.size(),circ.fill);
+			break;
+		}
+
+		case PRIM_POLYLINE:
+			polylines[item].draw();
+			++i;
+			break;
+
+		case PRIM_STAMP:
+			stamps[item].draw();
+			++i;
+			break;
+
+		case PRIM_SEGMENTS:
+			segment_sets[item].draw();
+			++i;
+			break;
+
+		case PRIM_POINTS:
+		{
+			auto &[col,set_pnts] = point_sets[item];
+			xDrawPoints(col,set_pnts.data(),set_pnts.size());
+			++i;
+			break;
+		}
+
+		case PRIM_POLYGON:
+		{
+			auto &[filled,col,shape,poly_pnts] = fill_polys[item];
+			xDrawPolygon(col,poly_pnts.data(),poly_pnts.size(),true);
+			++i;
+			break;
+		}
+
+		default:
+			assert(0);
+		}
+	}
+}
+
+
 
-	// Draw the turtle
-	draw();
 
-	XFlush(display);
+/*** Add a line to the polygon being built if SETFILL is on ***/
+void st_turtle::addFillLine(const st_turtle_line &tline)
+{
+	if (fill_shape) get<2>(fill_polys.back()).emplace_back(tline);
 }
 
 
@@ -388,6 +1417,8 @@ void st_turtle::drawAll()
      colour ***/
 void st_turtle::fill()
 {
+	if (recording) throw t_error({ ERR_CANT_IN_SHAPE, "" });
+
 	// X windows fill algo won't work if polygon is in seperate parts
 	if (win_edge == WIN_WRAPPED) throw t_error({ ERR_CANT_FILL, "" });
 	if (!fill_polys.size()) return;
@@ -407,30 +1438,183 @@ void st_turtle::fill()
 		fill_polys.pop_back();
 		return;
 	}
-	fillPolygon(pen_colour,polygon);
 
-	XFlush(display);
+	// Work out the points once and keep them for redraws
+	auto &pnts = get<3>(tup);
+	for(auto &tline: polygon) pnts.push_back(tline.from);
+	pnts.push_back(polygon.back().to);
+
+	undraw();
+	xDrawPolygon(pen_colour,pnts.data(),pnts.size(),true);
+	addPrim(PRIM_POLYGON,fill_polys.size() - 1);
+	checkMaxPrims();
+	draw();
 }
 
 
 
+/*** Once there are more than max_prims things stored for redrawing they're
+     all baked into a pixmap that xWindowClear() starts from and then thrown
+     away. This stops memory growing forever when something draws in a loop.
+     The exception is a polygon that's still being built as FILL needs its
+     lines. ***/
+void st_turtle::checkMaxPrims()
+{
+	if (!max_prims) return;
+
+	size_t cnt = prim_kinds.size() - dead_lines;
+	if (cnt <= (size_t)max_prims) return;
 
-void st_turtle::fillPolygon(int col, t_shape &polygon)
+	xBakeCanvas();
+	draw_lines.clear();
+	line_index.clear();
+	wrap_pieces.clear();
+	dead_lines = 0;
+	dots.clear();
+	circles.clear();
+	polylines.clear();
+	point_sets.clear();
+	stamps.clear();
+	segment_sets.clear();
+	prim_kinds.clear();
+	prim_items.clear();
+
+	if (fill_shape && fill_polys.size())
+	{
+		auto building = std::move(fill_polys.back());
+		fill_polys.clear();
+		fill_polys.emplace_back(std::move(building));
+	}
+	else fill_polys.clear();
+
+	baked_prims += cnt;
+	setGlobalVarValue("$baked_prims",(double)baked_prims);
+}
+
+
+
+/*** Store a line for redrawing. Drawing a circle with FD 1 RT 2 or going
+     round a loop adds a line for every step so they're kept down by
+     extending the previous line if this one carries straight on from it,
+     and by dropping an identical earlier line since this one draws exactly
+     over it and keeps it in the right order. ***/
+void st_turtle::addDrawLine(st_turtle_line &tline)
+{
+	// Can only extend the last line if nothing else has been drawn since
+	if (prim_kinds.size() && prim_kinds.back() == PRIM_LINE &&
+	    draw_lines.back().colour != -1)
+	{
+		size_t pos = draw_lines.size() - 1;
+		st_line_key old_key = draw_lines[pos].key();
+
+		if (draw_lines[pos].extend(tline))
+		{
+			wrap_pieces.erase(pos);
+			line_index.erase(old_key);
+			indexDrawLine(pos);
+			return;
+		}
+	}
+	draw_lines.emplace_back(tline);
+	addPrim(PRIM_LINE,draw_lines.size() - 1);
+	indexDrawLine(draw_lines.size() - 1);
+}
+
+
+
+
+void st_turtle::indexDrawLine(size_t pos)
+{
+	auto [it,added] = line_index.try_emplace(draw_lines[pos].key(),pos);
+	if (added) return;
+
+	draw_lines[it->second].colour = -1;
+	it->second = pos;
+
+	// Superseded lines are only removed once they're half the list as
+	// all the later positions in the index have to be updated
+	if (++dead_lines > draw_lines.size() / 2) compactDrawLines();
+}
+
+
+
+
+/*** Remove superseded lines from the lines and the drawing order, updating
+     the positions of the ones left ***/
+void st_turtle::compactDrawLines()
+{
+	vector<uint32_t> new_pos(draw_lines.size(),UINT32_MAX);
+	size_t from;
+	size_t to;
+
+	for(from=to=0;from < draw_lines.size();++from)
+	{
+		if (draw_lines[from].colour == -1) continue;
+		new_pos[from] = to;
+		if (from != to) draw_lines[to] = std::move(draw_lines[from]);
+		++to;
+	}
+	draw_lines.erase(draw_lines.begin() + to,draw_lines.end());
+
+	for(from=to=0;from < prim_kinds.size();++from)
+	{
+		uint32_t item = prim_items[from];
+		if (prim_kinds[from] == PRIM_LINE)
+		{
+			item = new_pos[item];
+			if (item == UINT32_MAX) continue;
+		}
+		prim_kinds[to] = prim_kinds[from];
+		prim_items[to] = item;
+		++to;
+	}
+	prim_kinds.resize(to);
+	prim_items.resize(to);
+
+	line_index.clear();
+	for(size_t pos=0;pos < draw_lines.size();++pos)
+		line_index[draw_lines[pos].key()] = pos;
+	dead_lines = 0;
+
+	// Positions have changed
+	wrap_pieces.clear();
+}
+
+
+
+
+/*** Draw a stored line. In wrap mode the pieces it's split into are kept
+     for redraws until the window size changes. ***/
+void st_turtle::drawLine(size_t pos)
 {
-	XPoint *pnts = new XPoint[polygon.size() + 1];
-	int i = 0;
+	st_turtle_line &tline = draw_lines[pos];
 
-	for(auto &tline: polygon)
+	if (win_edge != WIN_WRAPPED)
 	{
-		pnts[i].x = tline.from.x;
-		pnts[i].y = tline.from.y;
-		++i;
-		pnts[i].x = tline.to.x;
-		pnts[i].y = tline.to.y;
+		tline.draw();
+		return;
+	}
+	if (wrap_width != win_width || wrap_height != win_height)
+	{
+		wrap_pieces.clear();
+		wrap_width = win_width;
+		wrap_height = win_height;
 	}
-	xDrawPolygon(col,pnts,polygon.size()+1,true);
 
-	delete[] pnts;
+	auto [it,added] = wrap_pieces.try_emplace(pos);
+	if (added) tline.getWrapPieces(it->second);
+
+	GC lgc = xGetGC(tline.colour,tline.width,tline.style);
+	for(auto &seg: it->second) xDrawLine(lgc,seg.x1,seg.y1,seg.x2,seg.y2);
+}
+
+
+
+
+void st_turtle::addPrim(en_prim kind, size_t item)
+{
+	prim_kinds.push_back(kind);
+	prim_items.push_back(item);
 }
 
 ////////////////////////////////// MISC ///////////////////////////////////
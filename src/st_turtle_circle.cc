@@ -8,10 +8,12 @@ st_turtle_circle::st_turtle_circle(
 	line_width(lw),
 	fill(fl)
 {
-	x = (int)round(_x - xdm / 2);
-	y = (int)round(_y - ydm / 2);
-	x_diam = (int)round(xdm);
-	y_diam = (int)round(ydm);
+	arc.x = (short)round(_x - xdm / 2);
+	arc.y = (short)round(_y - ydm / 2);
+	arc.width = (unsigned short)round(xdm);
+	arc.height = (unsigned short)round(ydm);
+	arc.angle1 = 0;
+	arc.angle2 = 360 * 64;
 }
 
 
@@ -19,7 +21,17 @@ st_turtle_circle::st_turtle_circle(
 
 void st_turtle_circle::draw()
 {
-	xSetLineWidth(colour,line_width);
-	xSetLineStyle(colour,style);
-	xDrawCircle(colour,x_diam,y_diam,x,y,fill);
+	xDrawArcs(xGetGC(colour,line_width,style),&arc,1,fill);
+}
+
+
+
+
+/*** True if the circles can be drawn with the same call ***/
+bool st_turtle_circle::sameGC(const st_turtle_circle &circ)
+{
+	return circ.colour == colour &&
+	       circ.line_width == line_width &&
+	       circ.style == style &&
+	       circ.fill == fill;
 }
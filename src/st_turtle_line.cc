@@ -15,76 +15,113 @@ st_turtle_line::st_turtle_line(
 
 void st_turtle_line::draw()
 {
-	xSetLineWidth(colour,width);
-	xSetLineStyle(colour,style);
+	GC lgc = xGetGC(colour,width,style);
 
 	if (turtle->win_edge != WIN_WRAPPED)
 	{
-		xDrawLine(colour,from.x,from.y,to.x,to.y);
+		xDrawLine(lgc,from.x,from.y,to.x,to.y);
 		return;
 	}
 
-	/* If turtle drawing is wrapped then draw the seperate wrapped lines.
-	   Easier to do it iteratively than to try and work them all out
-	   beforehand. */
-	double x = from.x;
-	double y = from.y;
-	double start_x = x;
-	double start_y = y;
-	double xd = to.x - x;
-	double yd = to.y - y;
-	double axd = abs(xd);
-	double ayd = abs(yd);
-	double xa;
-	double ya;
-	int cnt;
-
-	if (axd > ayd)
-	{
-		xa = SGN(xd);
-		ya = yd / axd;
-		cnt = axd;
-	}
-	else
-	{
-		ya = SGN(yd);
-		xa = xd / ayd;
-		cnt = ayd;
-	}
-	for(int i=0;i < cnt;++i)
+	// Stored lines keep their pieces, see st_turtle::drawLine()
+	static vector<XSegment> pieces;
+	getWrapPieces(pieces);
+	for(auto &seg: pieces) xDrawLine(lgc,seg.x1,seg.y1,seg.x2,seg.y2);
+}
+
+
+
+
+/*** If turtle drawing is wrapped then the line is split into seperate 
+     pieces where it crosses the window edges. Working in unwrapped
+     co-ords, find how far along the line it next crosses a vertical and
+     a horizontal multiple of the window size, whichever comes first ends
+     the piece and the next one starts in the window cell it moves into.
+     Each piece is drawn shifted back by its cell. ***/
+void st_turtle_line::getWrapPieces(vector<XSegment> &pieces)
+{
+	double w = win_width;
+	double h = win_height;
+	double dx = to.x - from.x;
+	double dy = to.y - from.y;
+	double cell_x = floor(from.x / w);
+	double cell_y = floor(from.y / h);
+	double t1;
+	double t2 = 0;
+	double tx;
+	double ty;
+
+	pieces.clear();
+
+	do
 	{
-		// Wrap
-		if (x < 0)
-		{
-			xDrawLine(colour,start_x,start_y,x,y);
-			x += win_width;
-			start_x = x;
-			start_y = y;
-		}
-		else if (x >= win_width)
-		{
-			xDrawLine(colour,start_x,start_y,x,y);
-			x -= win_width;
-			start_x = x;
-			start_y = y;
-		}
+		t1 = t2;
+		if (dx > 0) tx = ((cell_x + 1) * w - from.x) / dx;
+		else if (dx < 0) tx = (cell_x * w - from.x) / dx;
+		else tx = 1;
 
-		if (y < 0)
-		{
-			xDrawLine(colour,start_x,start_y,x,y);
-			y += win_height;
-			start_x = x;
-			start_y = y;
-		}
-		else if (y >= win_height)
+		if (dy > 0) ty = ((cell_y + 1) * h - from.y) / dy;
+		else if (dy < 0) ty = (cell_y * h - from.y) / dy;
+		else ty = 1;
+
+		t2 = min(min(tx,ty),1.0);
+		if (t2 > t1 || t2 == 1)
 		{
-			xDrawLine(colour,start_x,start_y,x,y);
-			y -= win_height;
-			start_x = x;
-			start_y = y;
+			double xo = cell_x * w;
+			double yo = cell_y * h;
+			pieces.push_back({
+				(short)round(from.x + t1 * dx - xo),
+				(short)round(from.y + t1 * dy - yo),
+				(short)round(from.x + t2 * dx - xo),
+				(short)round(from.y + t2 * dy - yo)
+			});
 		}
-		x += xa;
-		y += ya;
-	}
-	xDrawLine(colour,start_x,start_y,x,y);
+		if (tx == t2) cell_x += SGN(dx);
+		if (ty == t2) cell_y += SGN(dy);
+	} while(t2 < 1);
+}
+
+
+
+
+/*** If the next line carries straight on from this one with the same
+     attributes then extend this one to its end. Only done for solid lines
+     as the dash pattern starts again with each line. ***/
+bool st_turtle_line::extend(const st_turtle_line &next)
+{
+	if (style != LineSolid ||
+	    next.style != style ||
+	    next.colour != colour ||
+	    next.width != width ||
+	    next.from.x != to.x ||
+	    next.from.y != to.y) return false;
+
+	// The products can overflow an int with the window unbounded
+	int64_t dx1 = to.x - from.x;
+	int64_t dy1 = to.y - from.y;
+	int64_t dx2 = next.to.x - next.from.x;
+	int64_t dy2 = next.to.y - next.from.y;
+
+	// Must be in line and the same direction, not doubling back
+	if (dx1 * dy2 != dy1 * dx2 || dx1 * dx2 + dy1 * dy2 <= 0) return false;
+
+	to = next.to;
+	return true;
+}
+
+
+
+
+/*** A solid line is the same whichever way round it was drawn but a dashed
+     one isn't as the dash pattern starts from the first end ***/
+st_line_key st_turtle_line::key()
+{
+	uint32_t p1 = ((uint32_t)(uint16_t)from.x << 16) | (uint16_t)from.y;
+	uint32_t p2 = ((uint32_t)(uint16_t)to.x << 16) | (uint16_t)to.y;
+	if (p1 > p2 && style == LineSolid) swap(p1,p2);
+
+	return { 
+		((uint64_t)p1 << 32) | p2, 
+		(uint32_t)(colour | (style << 8) | (width << 16))
+	};
 }
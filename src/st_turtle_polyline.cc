@@ -0,0 +1,28 @@
+#include "globals.h"
+
+st_turtle_polyline::st_turtle_polyline(int col, int wd, int st):
+	colour(col), width(wd), style(st)
+{
+}
+
+
+
+
+/*** Points that round to the same pixel as the last one are skipped ***/
+void st_turtle_polyline::addPoint(double x, double y)
+{
+	XPoint pnt = { (short)round(x), (short)round(y) };
+
+	if (pnts.size() && pnts.back().x == pnt.x && pnts.back().y == pnt.y)
+		return;
+	pnts.push_back(pnt);
+}
+
+
+
+
+void st_turtle_polyline::draw()
+{
+	if (pnts.size() > 1)
+		xDrawLines(xGetGC(colour,width,style),pnts.data(),pnts.size());
+}
@@ -0,0 +1,29 @@
+#include "globals.h"
+
+st_turtle_segments::st_turtle_segments(int col, int wd, int st):
+	colour(col), width(wd), style(st)
+{
+}
+
+
+
+
+void st_turtle_segments::addSegment(double xf, double yf, double xt, double yt)
+{
+	segs.push_back({
+		(short)round(xf),
+		(short)round(yf),
+		(short)round(xt),
+		(short)round(yt)
+	});
+}
+
+
+
+
+/*** xDrawLine() sends runs with the same GC as one request ***/
+void st_turtle_segments::draw()
+{
+	GC lgc = xGetGC(colour,width,style);
+	for(auto &seg: segs) xDrawLine(lgc,seg.x1,seg.y1,seg.x2,seg.y2);
+}
@@ -28,6 +28,31 @@ size_t st_user_proc_inst::setParams(st_line *line, size_t tokpos)
 
 
 
+/*** Set the parameters from values that have already been evaluated. Used
+     when a procedure is called natively, eg by MAP ***/
+void st_user_proc_inst::setParams(vector<st_value> &args)
+{
+	if (args.size() < proc->params.size())
+		throw t_error({ ERR_MISSING_ARG, proc->name });
+	if (args.size() > proc->params.size())
+		throw t_error({ ERR_UNEXPECTED_ARG, proc->name });
+
+	for(size_t pnum=0;pnum < args.size();++pnum)
+	{
+		string &pname = proc->params[pnum];
+
+		if (global_vars.find(pname) != global_vars.end())
+			throw t_error({ ERR_DUP_DECLARATION, pname });
+
+		if (watch_vars.find(pname) != watch_vars.end())
+			printWatch('P',pname,args[pnum]);
+		local_vars[pname] = args[pnum];
+	}
+}
+
+
+
+
 void st_user_proc_inst::setLocalVar(string &name, st_value &val)
 {
 	if (watch_vars.find(name) != watch_vars.end()) printWatch('L',name,val);
@@ -63,3 +88,81 @@ void st_user_proc_inst::execute()
 {
 	proc->execute();
 }
+
+
+//////////////////////////////// PROC CALLING ////////////////////////////////
+
+st_user_proc *getUserProc(const string &name)
+{
+	auto mit = user_procs.find(name);
+	if (mit == user_procs.end())
+		throw t_error({ ERR_UNDEFINED_UPROC, name });
+	return mit->second.get();
+}
+
+
+
+
+/*** Execute an instance whose parameters are already set. The instance is
+     deleted afterwards. Returns the OP value which is left unset if there
+     wasn't one ***/
+st_value runUserProcInst(st_user_proc_inst *inst)
+{
+	st_user_proc_inst *prev_inst = curr_proc_inst;
+	st_value retval;
+
+	curr_proc_inst = inst;
+
+	try
+	{
+		curr_proc_inst->execute();
+	}
+	catch(t_error)
+	{
+		if (!stop_proc) stop_proc = curr_proc_inst->proc;
+		delete curr_proc_inst;
+		curr_proc_inst = prev_inst;
+		throw;
+	}
+	catch(t_interrupt &inter)
+	{
+		if (inter.first != INT_RETURN)
+		{
+			if (!stop_proc) stop_proc = curr_proc_inst->proc;
+			delete curr_proc_inst;
+			curr_proc_inst = prev_inst;
+			throw;
+		}
+		assert(curr_proc_inst);
+		if (curr_proc_inst->ret_set)
+			retval = curr_proc_inst->retval.first;
+		// No result set, just return with empty result
+	}
+
+	delete curr_proc_inst;
+	curr_proc_inst = prev_inst;
+	return retval;
+}
+
+
+
+
+/*** Call a user procedure with already evaluated arguments. This skips the
+     token parsing of st_line::execUserProc() so is used by the procedures
+     that apply a user procedure to every element of a list ***/
+st_value callUserProc(st_line *line, st_user_proc *proc, vector<st_value> &args)
+{
+	st_user_proc_inst *new_inst = new st_user_proc_inst(proc);
+
+	try
+	{
+		new_inst->setParams(args);
+	}
+	catch(t_error &err)
+	{
+		delete new_inst;
+		throw;
+	}
+	if (tracing_mode) line->printTrace('U',proc->name.c_str());
+	return runUserProcInst(new_inst);
+}
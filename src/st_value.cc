@@ -26,6 +26,14 @@ st_value::st_value(string _str)
 
 
 
+st_value::st_value(const st_string &_str)
+{
+	set(_str);
+}
+
+
+
+
 st_value::st_value(const char *_str)
 {
 	set(_str);
@@ -105,8 +113,9 @@ void st_value::set(double _num)
 	num = _num;
 	listline.reset();
 
-	// Set for use in error messages
-	str = numToString(num);
+	// Not set to the number string as that would need a buffer allocating
+	// for every numeric result. toString() creates it if required.
+	str.clear();
 }
 
 
@@ -123,6 +132,18 @@ void st_value::set(string _str)
 
 
 
+/*** Shares the buffer with _str so no characters are copied ***/
+void st_value::set(const st_string &_str)
+{
+	type = TYPE_STR;
+	str = _str;
+	num = 0;
+	listline.reset();
+}
+
+
+
+
 void st_value::set(const char *_str)
 {
 	type = TYPE_STR;
@@ -138,10 +159,12 @@ void st_value::set(const char *_str)
 void st_value::set(shared_ptr<st_line> _listline)
 {
 	assert(_listline->type == LINE_LIST);
+	static const st_string def_list_str(DEF_LIST_STR);
+
 	type = TYPE_LIST;
 	listline = _listline;
 	num = 0;
-	str = DEF_LIST_STR;
+	str = def_list_str;
 }
 
 
@@ -277,7 +300,7 @@ bool st_value::operator<=(st_value &rval)
 
 bool st_value::operator>=(st_value &rval)
 {
-	if (type != rval.type) throw t_error({ ERR_INVALID_ARG, rval.str });
+	if (type != rval.type) throw t_error({ ERR_INVALID_ARG, rval.toString() });
 
 	switch(type)
 	{
@@ -427,7 +450,7 @@ bool st_value::isSet()
 	{
 	case TYPE_NUM : return (num != 0);
 	case TYPE_STR : return (str != "");
-	case TYPE_LIST: return (listline && listline->tokens.size());
+	case TYPE_LIST: return (listline && listline->listSize());
 	}
 	assert(0);
 	return false;
@@ -461,7 +484,12 @@ void st_value::negate()
 
 string st_value::toString()
 {
-	return (type == TYPE_LIST ? listline->listToString() : str);
+	switch(type)
+	{
+	case TYPE_NUM : return numToString(num);
+	case TYPE_LIST: return listline->listToString();
+	}
+	return str;
 }
 
 
@@ -33,7 +33,7 @@ t_result procFirstLast(st_line *line, size_t tokpos)
 	case TYPE_LIST:
 		val.set(result.first.listline->getListElement(
 			(sproc == SPROC_FIRST) ? 1 : 
-			result.first.listline->tokens.size()));
+			result.first.listline->listSize()));
 		break;
 	default:
 		assert(0);
@@ -68,7 +68,7 @@ t_result procBFL(st_line *line, size_t tokpos)
 	case TYPE_LIST:
 		{
 		st_line *rline = result.first.listline.get();
-		auto len = rline->tokens.size();
+		auto len = rline->listSize();
 		if (len < 2) val.set(make_shared<st_line>(true));
 		else
 		{
@@ -126,7 +126,7 @@ t_result procPiece(st_line *line, size_t tokpos)
 	case TYPE_LIST:
 		{
 		st_line *rline = result.first.listline.get();
-		if (from_pos > rline->tokens.size())
+		if (from_pos > rline->listSize())
 			oval.set(make_shared<st_line>(true));
 		else
 			oval.set(rline->getListPiece(from_pos,to_pos));
@@ -154,7 +154,7 @@ t_result procCount(st_line *line, size_t tokpos)
 		val.set(result.first.str.length());
 		break;
 	case TYPE_LIST:
-		val.set(result.first.listline->tokens.size());
+		val.set(result.first.listline->listSize());
 		break;
 	default:
 		assert(0);
@@ -268,7 +268,7 @@ t_result procItem(st_line *line, size_t tokpos)
 			rval.set(ival.str.substr(pos-1,1));
 		break;
 	case TYPE_LIST:
-		if (pos > (int)ival.listline->tokens.size())
+		if (pos > (int)ival.listline->listSize())
 			rval.set(make_shared<st_line>(true));
 		else
 			rval.set(ival.listline->getListElement(pos));
@@ -330,7 +330,9 @@ t_result procUpperCase(st_line *line, size_t tokpos)
 	if (val.type != TYPE_STR)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 
-	for(char &c: val.str) c = toupper(c);
+	string str = val.str;
+	for(char &c: str) c = toupper(c);
+	val.set(str);
 
 	return { val, result.second };
 }
@@ -345,7 +347,9 @@ t_result procLowerCase(st_line *line, size_t tokpos)
 	if (val.type != TYPE_STR)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
 
-	for(char &c: val.str) c = tolower(c);
+	string str = val.str;
+	for(char &c: str) c = tolower(c);
+	val.set(str);
 	return { val, result.second };
 }
 
@@ -419,6 +423,7 @@ t_result procRL(st_line *line, size_t tokpos)
      [<xpos> <ypos> <heading> <visible 1/0> <pen down 1/0> <pen colour> ***/
 t_result procTF(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
 	return { st_value(turtle->facts()), tokpos + 1 };
 }
@@ -464,7 +469,7 @@ t_result procStr(st_line *line, size_t tokpos)
 	}
 
 	// Anything else
-	return { st_value(val.str), result.second };
+	return { st_value(val.toString()), result.second };
 }
 
 
@@ -484,7 +489,7 @@ t_result procSplit(st_line *line, size_t tokpos)
 	res = line->evalExpression(tokpos);
 	if (res.first.type != TYPE_STR)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].strval });
-	string &str = res.first.str;
+	const string &str = res.first.str;
 
 	shared_ptr<st_line> listline = make_shared<st_line>(true);
 	size_t pos = 0;
@@ -526,8 +531,9 @@ t_result procShuffle(st_line *line, size_t tokpos)
 	case TYPE_STR:
 		{
 		size_t cnt = val.str.size();
-		string &str = val.str;
+		string str = val.str;
 		for(size_t i=0;i < cnt;++i) swap(str[i],str[random() % cnt]);
+		val.set(str);
 		}
 		break;
 	default:
@@ -874,7 +880,7 @@ t_result procPad(st_line *line, size_t tokpos)
 	// Get what to pad with 
 	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
 	rstr = line->evalExpression(tokpos);
-	string &padstr = rstr.first.str;
+	const string &padstr = rstr.first.str;
 	if (rstr.first.type != TYPE_STR || padstr.size() != 1)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].strval });
 	tokpos = rstr.second;
@@ -909,7 +915,8 @@ t_result procList(st_line *line, size_t tokpos)
 		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].strval });
 
 	shared_ptr<st_line> listline = make_shared<st_line>(true);
-	listline->tokenise(rstr.first.str);
+	string str = rstr.first.str;
+	listline->tokenise(str);
 
 	return { st_value(listline), rstr.second };
 }
@@ -942,6 +949,7 @@ t_result procPath(st_line *line, size_t tokpos)
 
 t_result procLoadSavePic(st_line *line, size_t tokpos)
 {
+	xWaitConnect();
 	if (!flags.graphics_enabled) throw t_error({ ERR_NO_GRAPHICS, "" });
 
 	string filename;
@@ -965,7 +973,7 @@ t_result procLoadSavePic(st_line *line, size_t tokpos)
 	}
 	shared_ptr<st_line> listline = make_shared<st_line>(true);
 	st_picture *pic;
-	XImage *img;
+	Pixmap pixmap;
 	uint32_t bytes;
 	int width;
 	int height;
@@ -976,13 +984,13 @@ t_result procLoadSavePic(st_line *line, size_t tokpos)
 		// Can't have empty filename (obviously)
 		if (filename == "")
 			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].strval });
-		tie(img,width,height,bytes) = loadPicFile(filename);
-		pic = createPicture(img,width,height);
+		tie(pixmap,width,height,bytes) = loadPicFile(filename);
+		pic = createPicture(pixmap,width,height);
 	}
 	else
 	{
-		tie(img,width,height,bytes) = savePicFile(filename);
-		pic = createPicture(img,width,height);
+		tie(pixmap,width,height,bytes) = savePicFile(filename);
+		pic = createPicture(pixmap,width,height);
 	}
 
 	listline->addToken(pic->id);
@@ -1003,3 +1011,513 @@ t_result procGetPics(st_line *line, size_t tokpos)
 	for(auto &[text,pic]: pictures) listline->addToken(text);
 	return { st_value(listline), tokpos+1 };
 }
+
+
+
+
+/*** Format: MAP/FILTER "<procedure>" <list or string>. The procedure is 
+     called with each element in turn. MAP returns a list of the values it
+     returned, FILTER returns the elements for which it returned a set value.
+     Procedure calls are made natively so the list is only evaluated once. ***/
+t_result procMapFilter(st_line *line, size_t tokpos)
+{
+	int sproc = line->tokens[tokpos].subtype;
+
+	// Get procedure name
+	t_result rproc = line->evalExpression(++tokpos);
+	if (rproc.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	st_user_proc *proc = getUserProc(rproc.first.str);
+
+	// Get what to apply it to
+	tokpos = rproc.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result rin = line->evalExpression(tokpos);
+	st_value &inval = rin.first;
+
+	shared_ptr<st_line> listline = make_shared<st_line>(true);
+	vector<st_value> args(1);
+	st_value ret;
+	string outstr;
+	size_t cnt;
+
+	switch(inval.type)
+	{
+	case TYPE_STR:
+		cnt = inval.str.size();
+		if (sproc == SPROC_MAP)
+			listline->tokens.reserve(cnt);
+		else
+			outstr.reserve(cnt);
+
+		for(size_t i=0;i < cnt;++i)
+		{
+			args[0].set(string(1,inval.str[i]));
+			ret = callUserProc(line,proc,args);
+			if (ret.type == TYPE_UNDEF)
+				throw t_error({ ERR_NO_RETURN_VALUE, proc->name });
+			if (sproc == SPROC_MAP)
+				listline->tokens.emplace_back(st_token(ret));
+			else if (ret.isSet())
+				outstr += inval.str[i];
+		}
+		if (sproc == SPROC_FILTER)
+			return { st_value(outstr), rin.second };
+		break;
+	case TYPE_LIST:
+		cnt = inval.listline->listSize();
+		listline->tokens.reserve(cnt);
+
+		// Don't hold a token reference across the call in case the
+		// procedure changes the list
+		for(size_t i=0;i < inval.listline->listSize();++i)
+		{
+			args[0] = inval.listline->getListElement(i+1);
+			ret = callUserProc(line,proc,args);
+			if (ret.type == TYPE_UNDEF)
+				throw t_error({ ERR_NO_RETURN_VALUE, proc->name });
+			if (sproc == SPROC_MAP)
+				listline->tokens.emplace_back(st_token(ret));
+			else if (!ret.isSet() || i >= inval.listline->listSize())
+				continue;
+			else if (inval.listline->range)
+				listline->tokens.emplace_back(st_token(args[0]));
+			else
+				listline->tokens.emplace_back(inval.listline->tokens[i]);
+		}
+		break;
+	default:
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+	return { st_value(listline), rin.second };
+}
+
+
+
+
+/*** Format: REDUCE "<procedure>" <initial value> <list or string>. The 
+     procedure is called with the accumulated value and each element and its
+     return value becomes the new accumulated value. Eg with an "add" 
+     procedure: REDUCE "add" 0 [1 2 3] -> 6 ***/
+t_result procReduce(st_line *line, size_t tokpos)
+{
+	// Get procedure name
+	t_result rproc = line->evalExpression(++tokpos);
+	if (rproc.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	st_user_proc *proc = getUserProc(rproc.first.str);
+
+	// Get initial value
+	tokpos = rproc.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result rinit = line->evalExpression(tokpos);
+
+	// Get list or string
+	tokpos = rinit.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result rin = line->evalExpression(tokpos);
+	st_value &inval = rin.first;
+
+	vector<st_value> args(2);
+	args[0] = rinit.first;
+
+	switch(inval.type)
+	{
+	case TYPE_STR:
+		for(char c: inval.str)
+		{
+			args[1].set(string(1,c));
+			args[0] = callUserProc(line,proc,args);
+			if (args[0].type == TYPE_UNDEF)
+				throw t_error({ ERR_NO_RETURN_VALUE, proc->name });
+		}
+		break;
+	case TYPE_LIST:
+		for(size_t i=0;i < inval.listline->listSize();++i)
+		{
+			args[1] = inval.listline->getListElement(i+1);
+			args[0] = callUserProc(line,proc,args);
+			if (args[0].type == TYPE_UNDEF)
+				throw t_error({ ERR_NO_RETURN_VALUE, proc->name });
+		}
+		break;
+	default:
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+	return { args[0], rin.second };
+}
+
+
+
+
+/*** Format: SORT <list> ["<procedure>" [<descending 0/1>]]. This is a stable
+     sort. Without a procedure elements are compared as per the < operator so
+     must be all numbers or all strings. The procedure is given 2 elements and
+     must return a set value if the first should come before the second. An
+     empty procedure name means use the default comparison. ***/
+t_result procSort(st_line *line, size_t tokpos)
+{
+	// Get list
+	t_result result = line->evalExpression(++tokpos);
+	if (result.first.type != TYPE_LIST)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	st_line *rline = result.first.listline.get();
+	size_t endpos = result.second;
+	st_user_proc *proc = NULL;
+
+	rline->expandRange();
+	bool descending = false;
+
+	// Get optional comparison procedure name
+	if (!line->isExprEnd(endpos))
+	{
+		t_result rproc = line->evalExpression(endpos);
+		if (rproc.first.type != TYPE_STR)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[endpos].toString() });
+		if (rproc.first.str != "") proc = getUserProc(rproc.first.str);
+		endpos = rproc.second;
+
+		// Get optional descending flag
+		if (!line->isExprEnd(endpos))
+		{
+			t_result rdesc = line->evalExpression(endpos);
+			if (rdesc.first.type != TYPE_NUM)
+			{
+				throw t_error({ ERR_INVALID_ARG,
+				                line->tokens[endpos].toString() });
+			}
+			descending = rdesc.first.isSet();
+			endpos = rdesc.second;
+		}
+	}
+
+	// Sort indexes into a vector of values so each token is only converted
+	// once and the original list is left untouched
+	size_t cnt = rline->tokens.size();
+	vector<st_value> vals;
+	vector<size_t> order(cnt);
+	vector<st_value> args(2);
+
+	vals.reserve(cnt);
+	for(size_t i=0;i < cnt;++i)
+	{
+		vals.emplace_back(st_value(rline->tokens[i]));
+		order[i] = i;
+	}
+
+	auto less = [&](size_t a, size_t b)
+	{
+		if (descending) swap(a,b);
+		if (!proc) return vals[a] < vals[b];
+
+		args[0] = vals[a];
+		args[1] = vals[b];
+		st_value ret = callUserProc(line,proc,args);
+		if (ret.type == TYPE_UNDEF)
+			throw t_error({ ERR_NO_RETURN_VALUE, proc->name });
+		return ret.isSet();
+	};
+
+	// A bottom up merge sort rather than stable_sort() as that can read
+	// outside the range if the user procedure isn't a consistent ordering.
+	// This only ever compares elements of the runs being merged. Taking
+	// from the left run unless the right is less keeps it stable.
+	vector<size_t> merged(cnt);
+	for(size_t width=1;width < cnt;width *= 2)
+	{
+		for(size_t lo=0;lo < cnt;lo += width * 2)
+		{
+			size_t mid = min(lo + width,cnt);
+			size_t hi = min(lo + width * 2,cnt);
+			size_t i = lo;
+			size_t j = mid;
+			size_t k = lo;
+
+			while(i < mid && j < hi)
+				merged[k++] = less(order[j],order[i]) ? order[j++] : order[i++];
+			while(i < mid) merged[k++] = order[i++];
+			while(j < hi) merged[k++] = order[j++];
+		}
+		order.swap(merged);
+	}
+
+	shared_ptr<st_line> listline = make_shared<st_line>(true);
+	listline->tokens.reserve(cnt);
+	for(size_t i: order) listline->tokens.emplace_back(rline->tokens[i]);
+
+	return { st_value(listline), endpos };
+}
+
+
+
+
+/*** Element wise maths on numeric lists. Format:
+     VADD|VSUB|VMUL|VDIV|VMOD|VPWR <list|number> <list|number>
+     VSCALE <list> <number>
+     VDOT <list> <list>
+     VSUM <list>
+     At least one operand must be a list and a number operand is applied to
+     every element. Two lists must be the same length. The lists are copied
+     into contiguous arrays once so the inner loops are simple and the
+     compiler is free to vectorise them. ***/
+t_result procVector(st_line *line, size_t tokpos)
+{
+	int sproc = line->tokens[tokpos].subtype;
+	st_value args[2];
+	vector<double> nums[2];
+	size_t cnt = 0;
+	int nargs = (sproc == SPROC_VSUM ? 1 : 2);
+	int i;
+
+	++tokpos;
+	for(i=0;i < nargs;++i)
+	{
+		if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+		t_result result = line->evalExpression(tokpos);
+		args[i] = result.first;
+		if (args[i].type == TYPE_LIST)
+		{
+			args[i].listline->getListNumbers(nums[i]);
+			if (i && args[0].type == TYPE_LIST && nums[i].size() != cnt)
+				throw t_error({ ERR_INVALID_ARG, args[i].toString() });
+			cnt = nums[i].size();
+		}
+		else if (args[i].type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, args[i].toString() });
+		tokpos = result.second;
+	}
+
+	// Validate operand combinations and spread number operands across
+	// an array so every loop below is list against list
+	switch(sproc)
+	{
+	case SPROC_VSUM:
+		if (args[0].type != TYPE_LIST)
+			throw t_error({ ERR_INVALID_ARG, args[0].toString() });
+		break;
+	case SPROC_VDOT:
+		for(i=0;i < 2;++i)
+		{
+			if (args[i].type != TYPE_LIST)
+				throw t_error({ ERR_INVALID_ARG, args[i].toString() });
+		}
+		break;
+	case SPROC_VSCALE:
+		if (args[0].type != TYPE_LIST)
+			throw t_error({ ERR_INVALID_ARG, args[0].toString() });
+		if (args[1].type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, args[1].toString() });
+		// Fall through
+	default:
+		if (args[0].type != TYPE_LIST && args[1].type != TYPE_LIST)
+			throw t_error({ ERR_INVALID_ARG, args[0].toString() });
+		for(i=0;i < 2;++i)
+		{
+			if (args[i].type == TYPE_NUM) nums[i].assign(cnt,args[i].num);
+		}
+	}
+
+	const double *a = nums[0].data();
+	const double *b = nums[1].data();
+	double total = 0;
+	size_t j;
+
+	switch(sproc)
+	{
+	case SPROC_VSUM:
+		for(j=0;j < cnt;++j) total += a[j];
+		return { st_value(total), tokpos };
+
+	case SPROC_VDOT:
+		for(j=0;j < cnt;++j) total += a[j] * b[j];
+		return { st_value(total), tokpos };
+
+	default:
+		break;
+	}
+
+	vector<double> out(cnt);
+	double *o = out.data();
+
+	switch(sproc)
+	{
+	case SPROC_VADD:
+		for(j=0;j < cnt;++j) o[j] = a[j] + b[j];
+		break;
+	case SPROC_VSUB:
+		for(j=0;j < cnt;++j) o[j] = a[j] - b[j];
+		break;
+	case SPROC_VMUL:
+	case SPROC_VSCALE:
+		for(j=0;j < cnt;++j) o[j] = a[j] * b[j];
+		break;
+	case SPROC_VDIV:
+		for(j=0;j < cnt;++j)
+		{
+			if (!b[j]) throw t_error({ ERR_DIVIDE_BY_ZERO, "VDIV" });
+			o[j] = a[j] / b[j];
+		}
+		break;
+	case SPROC_VMOD:
+		// Same as the % operator which keeps the mantissa
+		for(j=0;j < cnt;++j)
+		{
+			if (!(int)b[j]) throw t_error({ ERR_DIVIDE_BY_ZERO, "VMOD" });
+			o[j] = ((int)a[j] % (int)b[j]) + (a[j] - (int)a[j]);
+		}
+		break;
+	case SPROC_VPWR:
+		for(j=0;j < cnt;++j) o[j] = pow(a[j],b[j]);
+		break;
+	default:
+		assert(0);
+	}
+
+	shared_ptr<st_line> listline = make_shared<st_line>(true);
+	listline->setListNumbers(out);
+	return { st_value(listline), tokpos };
+}
+
+
+
+
+/*** Create a numeric list without creating its elements. Format:
+     RANGE <from> <to> [<step>]
+     ITERATE <from> <step> <count>
+     RANGE includes <to> if a whole number of steps reaches it. The default
+     step is 1 or -1 depending on direction. ***/
+t_result procRange(st_line *line, size_t tokpos)
+{
+	int sproc = line->tokens[tokpos].subtype;
+	double args[3];
+	double cnt;
+	int nargs = 3;
+	int i;
+
+	++tokpos;
+	for(i=0;i < nargs;++i)
+	{
+		if (i == 2 && sproc == SPROC_RANGE && line->isExprEnd(tokpos))
+		{
+			args[2] = (args[1] < args[0] ? -1 : 1);
+			break;
+		}
+		if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+		t_result result = line->evalExpression(tokpos);
+		if (result.first.type != TYPE_NUM)
+			throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+		args[i] = result.first.num;
+		tokpos = result.second;
+	}
+
+	double from = args[0];
+	double step;
+
+	if (sproc == SPROC_RANGE)
+	{
+		step = args[2];
+		if (!step) throw t_error({ ERR_INVALID_ARG, "0" });
+
+		// Allow for rounding errors with fractional steps
+		cnt = floor((args[1] - from) / step + 1e-9) + 1;
+		if (cnt < 0) cnt = 0;
+	}
+	else
+	{
+		step = args[1];
+		cnt = floor(args[2]);
+		if (cnt < 0) throw t_error({ ERR_INVALID_ARG, numToString(args[2]) });
+	}
+
+	// Elements are indexed with an int. A NaN or infinite argument can
+	// leave the count NaN which gets past the checks above.
+	if (!isfinite(cnt) || cnt > INT_MAX)
+		throw t_error({ ERR_INVALID_ARG, numToString(cnt) });
+
+	shared_ptr<st_line> listline = make_shared<st_line>(true);
+	listline->setListRange(from,step,(size_t)cnt);
+	return { st_value(listline), tokpos };
+}
+
+
+
+
+/*** Rewrite the axiom the given number of times. Format:
+     LSYSTEM <axiom> [<symbol> <replacement> ...] <iterations>
+     Symbols without a rule are copied as they are. The length of each
+     generation is worked out first so the string is only allocated once
+     per generation and never grows past MAX_LSYSTEM_LEN. ***/
+t_result procLSystem(st_line *line, size_t tokpos)
+{
+	// Get the axiom
+	if (line->isExprEnd(++tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	t_result result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_STR)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	string str = result.first.str;
+
+	// Get the rules
+	tokpos = result.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	result = line->evalExpression(tokpos);
+	if (result.first.type != TYPE_LIST)
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+
+	shared_ptr<st_line> rules = result.first.listline;
+	size_t cnt = rules->listSize();
+	string repl[256];
+	bool has_rule[256] = { false };
+
+	if (cnt % 2) throw t_error({ ERR_INVALID_ARG, rules->toString() });
+	for(size_t i=1;i < cnt;i += 2)
+	{
+		st_value sym = rules->getListElement(i);
+		st_value rep = rules->getListElement(i+1);
+
+		if (sym.type != TYPE_STR || sym.str.size() != 1)
+			throw t_error({ ERR_INVALID_ARG, sym.toString() });
+		if (rep.type != TYPE_STR)
+			throw t_error({ ERR_INVALID_ARG, rep.toString() });
+
+		uint8_t c = sym.str[0];
+		repl[c] = rep.str;
+		has_rule[c] = true;
+	}
+
+	// Get the iterations
+	tokpos = result.second;
+	if (line->isExprEnd(tokpos)) throw t_error({ ERR_MISSING_ARG, "" });
+	result = line->evalExpression(tokpos);
+	double iters = result.first.num;
+	if (result.first.type != TYPE_NUM ||
+	    iters < 0 || iters > MAX_LSYSTEM_ITERS || iters != floor(iters))
+	{
+		throw t_error({ ERR_INVALID_ARG, line->tokens[tokpos].toString() });
+	}
+
+	string next;
+	for(int gen=(int)iters;gen > 0;--gen)
+	{
+		if (flags.do_break) throw t_interrupt({ INT_BREAK, "" });
+
+		size_t len = 0;
+		for(uint8_t c: str)
+		{
+			len += has_rule[c] ? repl[c].size() : 1;
+			if (len > MAX_LSYSTEM_LEN)
+				throw t_error({ ERR_LSYSTEM_TOO_LONG, "" });
+		}
+
+		next.clear();
+		next.reserve(len);
+		for(uint8_t c: str)
+		{
+			if (has_rule[c])
+				next += repl[c];
+			else
+				next += (char)c;
+		}
+		str.swap(next);
+	}
+	return { st_value(str), result.second };
+}
@@ -15,6 +15,13 @@ void setSystemVars()
 	setGlobalVarValue("$pic_file_extension",LOGO_PIC_FILE_EXT);
 	setGlobalVarValue("$winpic","");
 	setGlobalVarValue("$angle_mode",flags.angle_in_degs ? "DEG" : "RAD");
+	setGlobalVarValue("$refresh_hz",refresh_hz);
+	setGlobalVarValue("$frame_rate",frame_rate);
+	setGlobalVarValue("$max_prims",max_prims);
+	setGlobalVarValue("$baked_prims",0);
+	setGlobalVarValue("$symmetry",1);
+	setGlobalVarValue("$mirror",0);
+	setGlobalVarValue("$num_turtles",1);
 
 	// LOGO isn't a system programming language so just provide the
 	// minimum of system info.
@@ -1,23 +1,108 @@
 #include "globals.h"
 
+static GC canvas_gc;
+static int canvas_width;
+static int canvas_height;
+
+// Older drawing that has been dropped from the turtle's lists. The mask has
+// the pixels that were drawn on so the background shows through the rest.
+static Pixmap baked;
+static Pixmap baked_mask;
+static int baked_width;
+static int baked_height;
+
+// GCs for line widths and styles other than the default keyed by
+// colour, style and width. At most GC_CACHE_SIZE are kept, the least
+// recently used going first, with the most recent at the front of the list.
+static unordered_map<uint32_t,pair<GC,list<uint32_t>::iterator>> gc_cache;
+static list<uint32_t> gc_lru;
+
+// Lines are queued and sent with one XDrawSegments() per GC
+static vector<XSegment> segments;
+static GC segments_gc;
+static bool draw_pending;
+static double last_flush;
+static double frame_deadline;
+
+// Set while the startup connection is being made in the background
+static future<bool> x_connecting;
+
+// MIT-SHM is used for images if the server supports it and is local
+static bool use_shm;
+static bool shm_error;
+
+// Pixel values for each colour. The GCs are created when first used.
+static unsigned long pixels[NUM_COLOURS];
+static GC gc[NUM_COLOURS];
+
+bool xOpen();
+void xConnected();
+void xCreatePalette(int white);
+XImage *xShmImageCreate(int width, int height);
+int xShmErrorHandler(Display *disp, XErrorEvent *event);
+unsigned long xMaskPixel(unsigned long mask, int val);
 void xWindowResized(XEvent &event);
+bool xCreateCanvas();
+void xDrawSegments();
+void xSpritesOver(GC dgc, XPoint *pnts, int cnt);
+void xSpritesOver(int x1, int y1, int x2, int y2);
+void xCopyBaked();
 
-/*** Set up X except for turtle GC which is done in st_turtle::st_turtle() ***/
 bool xConnect()
+{
+	printf("Connecting to X server \"%s\"...\n",XDisplayName(xdisp));
+	if (!xOpen()) return false;
+	xConnected();
+	return true;
+}
+
+
+
+
+/*** Used at startup so that the interpreter can get going while the X
+     server is dealt with in another thread. Nothing else touches X until
+     xWaitConnect() has collected the result. ***/
+void xConnectBackground()
+{
+	printf("Connecting to X server \"%s\"...\n",XDisplayName(xdisp));
+	x_connecting = async(launch::async,xOpen);
+}
+
+
+
+
+bool xConnecting()
+{
+	return x_connecting.valid() &&
+	       x_connecting.wait_for(chrono::seconds(0)) != future_status::ready;
+}
+
+
+
+
+/*** Anything that needs graphics calls this first. It only blocks if the 
+     startup connection is still being made. Failing to connect exits as it
+     always has done. ***/
+void xWaitConnect()
+{
+	if (!x_connecting.valid()) return;
+	if (!x_connecting.get()) doExit(1);
+	xConnected();
+}
+
+
+
+
+/*** Set up the X connection, window and GCs. The turtle GC is created in
+     st_turtle::st_turtle(). This must not touch any interpreter state as it
+     may be running in its own thread. ***/
+bool xOpen()
 {
 	Atom delete_notify;
 	XGCValues gcvals;
-	XColor colour;
-	XColor unused;
-	Colormap cmap;
 	int white;
 	int black;
-	int stage;
-	int col;
-	u_char r,g,b;
-	char colstr[10];
 
-	printf("Connecting to X server \"%s\"...\n",XDisplayName(xdisp));
 	if (!(display = XOpenDisplay(xdisp)))
 	{
 		puts("ERROR: Can't connect to X display.");
@@ -27,7 +112,6 @@ bool xConnect()
 	screen = DefaultScreen(display);
 	black = BlackPixel(display,screen);
 	white = WhitePixel(display,screen);
-	cmap = DefaultColormap(display,screen);
 	win_colour = WIN_DEFAULT_COL;
 
 	win = XCreateSimpleWindow(
@@ -37,28 +121,124 @@ bool xConnect()
 
 	XSetWindowBackground(display,win,black);
 	xSetWindowTitle();
+	xCreatePalette(white);
+	use_shm = XShmQueryExtension(display);
+
+	// XOR GC for the turtle. Foreground is set in xDrawTurtle()
+	gcvals.function = GXxor;
+	gcvals.line_width = 1;
+	turtle_gc = XCreateGC(display,win,GCFunction | GCLineWidth,&gcvals);
+
+	// Copying from a pixmap never needs exposures so don't ask for
+	// NoExpose events every time
+	gcvals.graphics_exposures = False;
+	canvas_gc = XCreateGC(display,win,GCGraphicsExposures,&gcvals);
+	xCreateCanvas();
+
+	x_sock = ConnectionNumber(display);
+
+	XSelectInput(display,win,ExposureMask | StructureNotifyMask);
+
+	// Don't kill process when window closed, send ClientMessage instead
+	delete_notify = XInternAtom(display,"WM_DELETE_WINDOW",True);
+	XSetWMProtocols(display,win,&delete_notify,1);
+
+	if (flags.map_window) XMapWindow(display,win);
+	return true;
+}
+
+
+
+
+/*** Finish off in the main thread once the connection is made ***/
+void xConnected()
+{
+	flags.window_mapped = flags.map_window;
+	turtle = new st_turtle;
+	puts("Graphics enabled.");
+}
+
+
+
+
+void xDisconnect()
+{
+	if (flags.graphics_enabled)
+	{
+		delete turtle;
+		turtle = NULL;
+
+		// Pictures and sprites are stored on the server so go with the
+		// connection
+		winpic.reset();
+		pictures.clear();
+		sprites.clear();
+		setGlobalVarValue("$winpic","");
+
+		assert(display);
+		XCloseDisplay(display);
+		flags.in_frame = false;
+
+		// All of these belonged to the old connection
+		gc_cache.clear();
+		gc_lru.clear();
+		segments.clear();
+		canvas = 0;
+		baked = 0;
+		baked_mask = 0;
+
+		puts("Graphics disabled.");
+	}
+}
+
+
+
+
+/*** The colours go green, turquoise, blue, mauve, red, yellow, black then
+     to white in 4 bit steps of each component. On a TrueColor display the
+     pixel values are worked out here from the visual's masks which saves a
+     round trip to the server for every colour. Otherwise they have to be
+     allocated from the colour map. ***/
+void xCreatePalette(int white)
+{
+	Visual *visual = DefaultVisual(display,screen);
+	Colormap cmap = DefaultColormap(display,screen);
+	XColor colour;
+	XColor unused;
+	int stage;
+	int col;
+	u_char r,g,b;
+	char colstr[10];
 
 	r = 0;
 	g = 0xF;
 	b = 0;
 	stage = 1;
 
-	gcvals.foreground = white;
-	gcvals.line_width = 1;
-
 	for(col=0;col < NUM_COLOURS;++col)
 	{
-		sprintf(colstr,"#%01X%01X%01X",r,g,b);
+		gc[col] = 0;
 
-		if (!XAllocNamedColor(display,cmap,colstr,&colour,&unused))
+		if (visual->c_class == TrueColor)
 		{
-			printf("WARNING: Can't allocate colour %s\n",colstr);
-			gcvals.foreground = white;
+			// Same as the server would give for "#RGB" which sets
+			// the top 4 bits of each 16 bit component
+			pixels[col] = 
+				xMaskPixel(visual->red_mask,r << 12) |
+				xMaskPixel(visual->green_mask,g << 12) |
+				xMaskPixel(visual->blue_mask,b << 12);
+		}
+		else
+		{
+			sprintf(colstr,"#%01X%01X%01X",r,g,b);
+
+			if (!XAllocNamedColor(display,cmap,colstr,&colour,&unused))
+			{
+				printf("WARNING: Can't allocate colour %s\n",colstr);
+				pixels[col] = white;
+			}
+			else pixels[col] = colour.pixel;
 		}
-		else gcvals.foreground = colour.pixel;
-
-		gcvals.line_width = 1;
-		gc[col] = XCreateGC(display,win,GCForeground | GCLineWidth,&gcvals);
 
 		switch(stage)
 		{
@@ -99,54 +279,39 @@ bool xConnect()
 			++b;
 		}
 	}
-
-	x_sock = ConnectionNumber(display);
-
-	XSelectInput(display,win,ExposureMask | StructureNotifyMask);
-
-	// Don't kill process when window closed, send ClientMessage instead
-	delete_notify = XInternAtom(display,"WM_DELETE_WINDOW",True);
-	XSetWMProtocols(display,win,&delete_notify,1);
-
-	if (flags.map_window)
-	{
-		XMapWindow(display,win);
-		flags.window_mapped = true;
-	}
-
-	// Create the turtle
-	turtle = new st_turtle;
-	puts("Graphics enabled.");
-
-	return true;
 }
 
 
 
 
-void xDisconnect()
+/*** Put the top bits of the 16 bit component value into the mask ***/
+unsigned long xMaskPixel(unsigned long mask, int val)
 {
-	if (flags.graphics_enabled)
-	{
-		delete turtle;
-		turtle = NULL;
+	int shift = 0;
+	int bits = 0;
 
-		assert(display);
-		XCloseDisplay(display);
+	if (!mask) return 0;
+	for(;!(mask & 1);mask >>= 1) ++shift;
+	for(;mask & 1;mask >>= 1) ++bits;
+	if (bits > 16) bits = 16;
 
-		puts("Graphics disabled.");
-	}
+	return (unsigned long)(val >> (16 - bits)) << shift;
 }
 
 
 
 
+/*** Exposed areas are copied back from the canvas so the drawing doesn't
+     have to be replayed ***/
 void xParseEvent()
 {
 	XEvent event;
 	XEvent conf_event;
-	bool redraw = false;
 	bool configure = false;
+	int x1 = win_width;
+	int y1 = win_height;
+	int x2 = 0;
+	int y2 = 0;
 
 	while(XPending(display))
 	{
@@ -155,8 +320,15 @@ void xParseEvent()
 		switch(event.type)
 		{
 		case Expose:
+			x1 = min(x1,event.xexpose.x);
+			y1 = min(y1,event.xexpose.y);
+			x2 = max(x2,event.xexpose.x + event.xexpose.width);
+			y2 = max(y2,event.xexpose.y + event.xexpose.height);
+			break;
 		case MapNotify:
-			redraw = true;
+			x1 = y1 = 0;
+			x2 = win_width;
+			y2 = win_height;
 			break;
 		case ConfigureNotify:
 			conf_event = event;
@@ -169,19 +341,48 @@ void xParseEvent()
 			break;
 		}
 	}
-	if (redraw) turtle->drawAll();
 	if (configure) xWindowResized(conf_event);
+	if (x2 > x1 && y2 > y1)
+	{
+		// The turtle is XOR drawn on the window only so take it off
+		// first otherwise undrawing it later would corrupt the copy
+		turtle->undraw();
+		xCopyCanvas(x1,y1,x2 - x1,y2 - y1);
+		turtle->draw();
+		xFlush(true);
+	}
 }
 
 
 
 
+/*** The canvas has to be the same size as the window so the drawing is
+     replayed into a new one if the size changed ***/
 void xWindowResized(XEvent &event)
 {
 	win_width = event.xconfigure.width;
 	win_height = event.xconfigure.height;
 	xSetWindowTitle();
 	setWindowSystemVars();
+	if (xCreateCanvas()) turtle->drawAll();
+}
+
+
+
+
+/*** Create the pixmap everything is drawn into as well as the window. 
+     Returns true if a new one was created. ***/
+bool xCreateCanvas()
+{
+	if (canvas && canvas_width == win_width && canvas_height == win_height)
+		return false;
+
+	if (canvas) XFreePixmap(display,canvas);
+	canvas = XCreatePixmap(
+		display,win,win_width,win_height,DefaultDepth(display,screen));
+	canvas_width = win_width;
+	canvas_height = win_height;
+	return true;
 }
 
 
@@ -203,40 +404,279 @@ void xSetWindowTitle()
 
 void xSetWindowBackground(int col)
 {
-        XGCValues gcvals;
-        XGetGCValues(display,gc[col],GCForeground,&gcvals);
-        XSetWindowBackground(display,win,gcvals.foreground);
+	XSetWindowBackground(display,win,pixels[col]);
 }
 
 
 
 
-void xSetLineWidth(int col, int width)
+/*** Get the GC for the colour, line width and style. They're created the
+     first time they're needed then kept so drawing never changes a GC. The
+     standard colour GCs are used for width 1 solid lines and the rest are
+     freed once they're the least recently used of too many. ***/
+GC xGetGC(int col, int width, int style)
 {
 	XGCValues gcvals;
-	gcvals.line_width = width;
-	XChangeGC(display,gc[col],GCLineWidth,&gcvals);
-}
 
+	if (width == 1 && style == LineSolid)
+	{
+		if (!gc[col])
+		{
+			gcvals.foreground = pixels[col];
+			gcvals.line_width = 1;
+			gc[col] = XCreateGC(
+				display,win,GCForeground | GCLineWidth,&gcvals);
+		}
+		return gc[col];
+	}
 
+	uint32_t key = col | (style << 8) | ((uint32_t)width << 16);
+	auto it = gc_cache.find(key);
+	if (it != gc_cache.end())
+	{
+		gc_lru.splice(gc_lru.begin(),gc_lru,it->second.second);
+		return it->second.first;
+	}
 
+	if (gc_cache.size() >= GC_CACHE_SIZE)
+	{
+		auto old = gc_cache.find(gc_lru.back());
+		GC oldgc = old->second.first;
+
+		// Lines queued with it have to go first
+		if (segments.size() && segments_gc == oldgc) xDrawSegments();
+		XFreeGC(display,oldgc);
+		gc_cache.erase(old);
+		gc_lru.pop_back();
+	}
 
-void xSetLineStyle(int col, int style)
-{
-	XGCValues gcvals;
+	gcvals.foreground = pixels[col];
+	gcvals.line_width = width;
 	gcvals.line_style = style;
-	XChangeGC(display,gc[col],GCLineStyle,&gcvals);
+	GC newgc = XCreateGC(
+		display,win,GCForeground | GCLineWidth | GCLineStyle,&gcvals);
+	gc_lru.push_front(key);
+	gc_cache[key] = { newgc, gc_lru.begin() };
+	return newgc;
 }
 
 
 
 
-/*** Clears the window and writes any background image ***/
+/*** Clears the canvas, writes any background image and baked drawing into it
+     then copies it to the window ***/
 void xWindowClear()
 {
-	XClearWindow(display,win);
+	// No point drawing anything thats about to be cleared
+	segments.clear();
+
+	XFillRectangle(
+		display,canvas,xGetGC(win_colour),0,0,win_width,win_height);
 	if (winpic) winpic->draw(); 
+	xCopyBaked();
+	xCopyCanvas(0,0,win_width,win_height);
+}
+
+
+
+
+void xCopyBaked()
+{
+	if (!baked) return;
+	XSetClipMask(display,canvas_gc,baked_mask);
+	XCopyArea(
+		display,baked,canvas,canvas_gc,0,0,baked_width,baked_height,0,0);
+	XSetClipMask(display,canvas_gc,None);
+}
+
+
+
+
+/*** While a frame is being built the window is left alone until
+     xEndFrame() copies the whole lot. Sprites aren't in the canvas so the
+     parts of them in the area go back on top. ***/
+void xCopyCanvas(int x, int y, int width, int height)
+{
+	xDrawSegments();
+	if (flags.in_frame) return;
+	XCopyArea(display,canvas,win,canvas_gc,x,y,width,height,x,y);
+	xSpritesOver(x,y,x + width,y + height);
+	draw_pending = true;
+}
+
+
+
+
+/*** Send queued drawing to the X server. Unless forced this is done at most
+     refresh_hz times a second so that lots of small moves go out together.
+     A refresh_hz of zero means every call flushes. ***/
+void xFlush(bool force)
+{
+	if (!draw_pending) return;
+
+	double now = getTime();
+	if (!force && refresh_hz && now - last_flush < 1 / refresh_hz) return;
+
+	xDrawSegments();
 	XFlush(display);
+	last_flush = now;
+	draw_pending = false;
+}
+
+
+
+
+void xSetRefresh(double hz)
+{
+	if (hz < 0) throw t_error({ ERR_INVALID_ARG, numToString(hz) });
+	refresh_hz = hz;
+	setGlobalVarValue("$refresh_hz",refresh_hz);
+	xFlush(true);
+}
+
+
+
+
+/*** Drawing goes only into the canvas until xEndFrame() so nothing is seen
+     half finished. The turtle is taken off the window now as it can't be
+     XOR drawn during the frame. ***/
+void xBeginFrame()
+{
+	if (flags.in_frame) return;
+	turtle->undraw();
+	xDrawSegments();
+	flags.in_frame = true;
+}
+
+
+
+
+/*** Copy the finished frame to the window in one go. If pacing then wait
+     until the next frame deadline. The deadlines are absolute so time
+     spent drawing doesn't add to the frame period, but if we've fallen
+     more than a frame behind they restart from now rather than rushing
+     through frames to catch up. ***/
+void xEndFrame(bool pace)
+{
+	if (flags.in_frame)
+	{
+		// No X drawing done as still in the frame, just resets its state
+		turtle->undraw();
+		flags.in_frame = false;
+		xCopyCanvas(0,0,win_width,win_height);
+		turtle->draw();
+	}
+	xFlush(true);
+	if (!pace || !frame_rate) return;
+
+	double period = 1 / frame_rate;
+	double now = getTime();
+	if (frame_deadline < now - period) frame_deadline = now;
+	frame_deadline += period;
+
+	struct timespec ts;
+	ts.tv_sec = (time_t)frame_deadline;
+	ts.tv_nsec = (long)((frame_deadline - ts.tv_sec) * 1000000000);
+
+	// A signal such as a break interrupts it which is what we want
+	clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL);
+}
+
+
+
+
+void xSetFrameRate(double fps)
+{
+	if (fps < 0) throw t_error({ ERR_INVALID_ARG, numToString(fps) });
+	frame_rate = fps;
+	setGlobalVarValue("$frame_rate",frame_rate);
+}
+
+
+
+
+void xSetMaxPrims(int max)
+{
+	if (max < 0) throw t_error({ ERR_INVALID_ARG, numToString(max) });
+	max_prims = max;
+	setGlobalVarValue("$max_prims",max_prims);
+	turtle->checkMaxPrims();
+}
+
+
+
+
+/*** Keep the drawing so far without the background or picture so that a
+     later SETBG or SETPIC still shows behind it. It's drawn again into a
+     pixmap of its own filled with a pixel value none of the colours use and
+     the pixels that no longer have that value make the mask. ***/
+void xBakeCanvas()
+{
+	unsigned long blank = 0;
+	for(int col=0;col < NUM_COLOURS;++col)
+	{
+		if (pixels[col] == blank)
+		{
+			++blank;
+			col = -1;
+		}
+	}
+
+	// Point the drawing functions at the new pixmap and keep them off the
+	// window while they draw into it
+	xDrawSegments();
+	Pixmap real_canvas = canvas;
+	bool in_frame = flags.in_frame;
+	canvas = xPixmapCreate(win_width,win_height);
+	flags.in_frame = true;
+
+	XSetForeground(display,canvas_gc,blank);
+	XFillRectangle(display,canvas,canvas_gc,0,0,win_width,win_height);
+	xCopyBaked();
+	turtle->drawPrims();
+	xDrawSegments();
+
+	Pixmap pixmap = canvas;
+	canvas = real_canvas;
+	flags.in_frame = in_frame;
+
+	// Build the mask as bitmap data, 1 bit per pixel, LSB first
+	XImage *img = xGetImage(pixmap,win_width,win_height);
+	int bytes_per_line = (win_width + 7) / 8;
+	vector<char> bits(bytes_per_line * win_height,0);
+	if (img)
+	{
+		for(int y=0;y < win_height;++y)
+		{
+			for(int x=0;x < win_width;++x)
+			{
+				if (XGetPixel(img,x,y) != blank)
+					bits[y * bytes_per_line + x / 8] |= 1 << (x % 8);
+			}
+		}
+		xImageDestroy(img);
+	}
+
+	xFreeBaked();
+	baked = pixmap;
+	baked_mask = XCreatePixmapFromBitmapData(
+		display,win,bits.data(),win_width,win_height,1,0,1);
+	baked_width = win_width;
+	baked_height = win_height;
+}
+
+
+
+
+void xFreeBaked()
+{
+	if (baked)
+	{
+		XFreePixmap(display,baked);
+		XFreePixmap(display,baked_mask);
+		baked = 0;
+		baked_mask = 0;
+	}
 }
 
 
@@ -247,6 +687,7 @@ void xWindowMap()
 	if (flags.graphics_enabled)
 	{
 		XMapWindow(display,win);
+		xFlush(true);
 		XFlush(display);
 		flags.window_mapped = true;
 	}
@@ -261,6 +702,7 @@ void xWindowUnmap()
 	if (flags.graphics_enabled)
 	{
 		XUnmapWindow(display,win);
+		xFlush(true);
 		XFlush(display);
 		flags.window_mapped = false;
 	}
@@ -282,14 +724,27 @@ void xWindowResize(int width, int height, bool force_set)
 		win_height = height;
 		xSetWindowTitle();
 		setWindowSystemVars();
+
+		// The ConfigureNotify will find the size already set so won't
+		// replay the drawing into the new canvas
+		if (xCreateCanvas() && turtle) turtle->drawAll();
 	}
 }
 
 
 
 
+/*** Images are only needed to get pictures to and from files. If the
+     server is local they're put in shared memory so the pixels don't have
+     to be copied through the socket. ***/
 XImage *xImageCreate(int width, int height)
 {
+	if (use_shm)
+	{
+		XImage *img = xShmImageCreate(width,height);
+		if (img) return img;
+	}
+
 	char *data = (char *)malloc(width * height * sizeof(uint32_t));
 	assert(data);
 
@@ -297,32 +752,201 @@ XImage *xImageCreate(int width, int height)
 		display,
 		DefaultVisual(display,screen),
 		DefaultDepth(display,screen),
-		XYPixmap,0,data,width,height,32,0);
+		ZPixmap,0,data,width,height,32,0);
 }
 
 
 
 
-void xDrawPoint(int col, int x, int y)
+/*** XShmCreateImage() puts the segment info in obdata so we know which
+     images are shared ***/
+void xImageDestroy(XImage *img)
 {
-	XDrawPoint(display,win,gc[col],x,y);
+	XShmSegmentInfo *info = (XShmSegmentInfo *)img->obdata;
+
+	if (info)
+	{
+		XShmDetach(display,info);
+		XDestroyImage(img);
+		shmdt(info->shmaddr);
+		delete info;
+	}
+	else XDestroyImage(img);
 }
 
 
 
 
-void xDrawLine(int col, int xf, int yf, int xt, int yt)
+/*** Create an image in a shared memory segment. On any failure returns NULL
+     and if the server couldn't attach it, which happens if it's remote,
+     doesn't try again ***/
+XImage *xShmImageCreate(int width, int height)
 {
-	XDrawLine(display,win,gc[col],xf,yf,xt,yt);
+	XShmSegmentInfo *info = new XShmSegmentInfo;
+	XImage *img = XShmCreateImage(
+		display,
+		DefaultVisual(display,screen),
+		DefaultDepth(display,screen),
+		ZPixmap,NULL,info,width,height);
+	if (!img)
+	{
+		delete info;
+		return NULL;
+	}
+
+	info->shmid = shmget(
+		IPC_PRIVATE,img->bytes_per_line * img->height,IPC_CREAT | 0600);
+	info->shmaddr = NULL;
+	if (info->shmid != -1)
+	{
+		info->shmaddr = (char *)shmat(info->shmid,0,0);
+		if (info->shmaddr == (char *)-1) info->shmaddr = NULL;
+	}
+	img->data = info->shmaddr;
+	info->readOnly = False;
+
+	bool attached = false;
+	if (info->shmaddr)
+	{
+		// The server reports a failure as an X error
+		XSync(display,False);
+		XErrorHandler old_handler = XSetErrorHandler(xShmErrorHandler);
+		shm_error = false;
+		XShmAttach(display,info);
+		XSync(display,False);
+		XSetErrorHandler(old_handler);
+
+		if (shm_error) use_shm = false;
+		else attached = true;
+	}
+
+	// Marked for removal now so it goes when both sides have detached
+	// even if we crash
+	if (info->shmid != -1) shmctl(info->shmid,IPC_RMID,NULL);
+	if (attached) return img;
+
+	if (info->shmaddr) shmdt(info->shmaddr);
+	img->data = NULL;
+	XDestroyImage(img);
+	delete info;
+	return NULL;
+}
+
+
+
+
+int xShmErrorHandler(Display *disp, XErrorEvent *event)
+{
+	shm_error = true;
+	return 0;
+}
+
+
+
+
+Pixmap xPixmapCreate(int width, int height)
+{
+	return XCreatePixmap(
+		display,win,width,height,DefaultDepth(display,screen));
+}
+
+
+
+
+/*** With shared memory the server reads straight from the image so we have
+     to wait until it's done before the image can be changed or freed ***/
+void xPutImage(Pixmap pixmap, XImage *img, int width, int height)
+{
+	if (img->obdata)
+	{
+		XShmPutImage(
+			display,pixmap,canvas_gc,img,0,0,0,0,width,height,False);
+		XSync(display,False);
+	}
+	else XPutImage(display,pixmap,canvas_gc,img,0,0,0,0,width,height);
+}
+
+
+
+
+XImage *xGetImage(Pixmap pixmap, int width, int height)
+{
+	if (use_shm)
+	{
+		XImage *img = xShmImageCreate(width,height);
+		if (img)
+		{
+			if (XShmGetImage(display,pixmap,img,0,0,AllPlanes))
+				return img;
+			xImageDestroy(img);
+		}
+	}
+	return XGetImage(display,pixmap,0,0,width,height,AllPlanes,ZPixmap);
 }
 
 
 
 
-void xDrawLine(int col, double xf, double yf, double xt, double yt)
+/*** Returns a new pixmap with a copy of the canvas in it ***/
+Pixmap xCopyCanvasToPixmap()
 {
-	XDrawLine(
-		display,win,gc[col],
+	Pixmap pixmap = xPixmapCreate(win_width,win_height);
+
+	xDrawSegments();
+	XCopyArea(
+		display,canvas,pixmap,canvas_gc,
+		0,0,win_width,win_height,0,0);
+	return pixmap;
+}
+
+
+
+
+void xCopyPixmapToCanvas(Pixmap pixmap, int width, int height)
+{
+	XCopyArea(display,pixmap,canvas,canvas_gc,0,0,width,height,0,0);
+}
+
+
+
+
+/*** All the drawing functions draw into the canvas as well as the window
+     so exposes can be dealt with by copying from the canvas. Inside a frame
+     they only draw into the canvas. ***/
+void xDrawPoints(int col, XPoint *pnts, int cnt)
+{
+	GC pgc = xGetGC(col);
+
+	xDrawSegments();
+	XDrawPoints(display,canvas,pgc,pnts,cnt,CoordModeOrigin);
+	if (!flags.in_frame)
+	{
+		XDrawPoints(display,win,pgc,pnts,cnt,CoordModeOrigin);
+		xSpritesOver(pgc,pnts,cnt);
+	}
+	draw_pending = true;
+}
+
+
+
+
+/*** Lines are queued until something else is drawn, the GC changes or
+     xFlush() sends them ***/
+void xDrawLine(GC lgc, int xf, int yf, int xt, int yt)
+{
+	if (segments.size() && lgc != segments_gc) xDrawSegments();
+	segments_gc = lgc;
+	segments.push_back({ (short)xf, (short)yf, (short)xt, (short)yt });
+	draw_pending = true;
+}
+
+
+
+
+void xDrawLine(GC lgc, double xf, double yf, double xt, double yt)
+{
+	xDrawLine(
+		lgc,
 		(int)round(xf),
 		(int)round(yf),
 		(int)round(xt),
@@ -334,20 +958,166 @@ void xDrawLine(int col, double xf, double yf, double xt, double yt)
 
 void xDrawPolygon(int col, XPoint *pnts, int cnt, bool fill)
 {
-	if (fill)
-		XFillPolygon(display,win,gc[col],pnts,cnt,Nonconvex,CoordModeOrigin);
-	else
-		XDrawLines(display,win,gc[col],pnts,cnt,CoordModeOrigin);
+	GC pgc = xGetGC(col);
+
+	xDrawSegments();
+	draw_pending = true;
+	for(Drawable d: { (Drawable)canvas, (Drawable)win })
+	{
+		if (d == win && flags.in_frame) break;
+		if (fill)
+			XFillPolygon(display,d,pgc,pnts,cnt,Nonconvex,CoordModeOrigin);
+		else
+			XDrawLines(display,d,pgc,pnts,cnt,CoordModeOrigin);
+	}
+	if (!flags.in_frame) xSpritesOver(pgc,pnts,cnt);
+}
+
+
+
+
+/*** Xlib doesn't split up XDrawLines() if there are too many points for one
+     request so do it here, overlapping by a point so the lines join ***/
+void xDrawLines(GC lgc, XPoint *pnts, int cnt)
+{
+	long max_req = XExtendedMaxRequestSize(display);
+	if (!max_req) max_req = XMaxRequestSize(display);
+
+	// Request size is in 4 byte units, the same size as an XPoint, and
+	// the request header is 3 of them
+	int max_pnts = (int)min(max_req - 3,(long)INT_MAX);
+
+	xDrawSegments();
+	draw_pending = true;
+	for(Drawable d: { (Drawable)canvas, (Drawable)win })
+	{
+		if (d == win && flags.in_frame) break;
+		for(int i=0;i < cnt - 1;i += max_pnts - 1)
+		{
+			XDrawLines(
+				display,d,lgc,
+				pnts + i,min(cnt - i,max_pnts),CoordModeOrigin);
+		}
+	}
+	if (!flags.in_frame) xSpritesOver(lgc,pnts,cnt);
+}
+
+
+
+
+void xDrawArcs(GC agc, XArc *arcs, int cnt, bool fill)
+{
+	xDrawSegments();
+	draw_pending = true;
+	for(Drawable d: { (Drawable)canvas, (Drawable)win })
+	{
+		if (d == win && flags.in_frame) break;
+		if (fill)
+			XFillArcs(display,d,agc,arcs,cnt);
+		else
+			XDrawArcs(display,d,agc,arcs,cnt);
+	}
+	if (flags.in_frame || sprites.empty()) return;
+
+	XGCValues gcvals;
+	XGetGCValues(display,agc,GCLineWidth,&gcvals);
+	int pad = gcvals.line_width / 2 + 1;
+	int x1 = INT_MAX;
+	int y1 = INT_MAX;
+	int x2 = INT_MIN;
+	int y2 = INT_MIN;
+
+	for(XArc *arc=arcs;arc < arcs + cnt;++arc)
+	{
+		x1 = min(x1,arc->x - pad);
+		y1 = min(y1,arc->y - pad);
+		x2 = max(x2,arc->x + arc->width + pad);
+		y2 = max(y2,arc->y + arc->height + pad);
+	}
+	xSpritesOver(x1,y1,x2,y2);
 }
 
 
 
 
-void xDrawCircle(int col, int x_diam, int y_diam, int x, int y, bool fill)
+/*** Draw using XOR so drawing the same shape again erases it. The foreground
+     is the pen colour XORed with the background so that on an empty
+     background the turtle appears in the pen colour. ***/
+void xDrawTurtle(int col, XPoint *pnts, int cnt, bool fill)
 {
-	static const int circle = 23040;
+	XGCValues gcvals;
+
+	xDrawSegments();
+	if (flags.in_frame) return;
+	draw_pending = true;
+
+	gcvals.foreground = pixels[col] ^ pixels[win_colour];
+	XChangeGC(display,turtle_gc,GCForeground,&gcvals);
+
 	if (fill)
-		XFillArc(display,win,gc[col],x,y,x_diam,y_diam,0,circle);
-	else
-		XDrawArc(display,win,gc[col],x,y,x_diam,y_diam,0,circle);
+	{
+		XFillPolygon(
+			display,win,turtle_gc,pnts,cnt,Nonconvex,CoordModeOrigin);
+	}
+	else XDrawLines(display,win,turtle_gc,pnts,cnt,CoordModeOrigin);
+}
+
+
+
+
+void xDrawSegments()
+{
+	if (segments.empty()) return;
+
+	XDrawSegments(
+		display,canvas,segments_gc,segments.data(),segments.size());
+	if (!flags.in_frame)
+	{
+		XDrawSegments(
+			display,win,segments_gc,segments.data(),segments.size());
+
+		// A segment's ends are consecutive points
+		xSpritesOver(
+			segments_gc,(XPoint *)segments.data(),segments.size() * 2);
+	}
+	segments.clear();
+}
+
+
+
+
+/*** Drawing goes to the window as well as the canvas so any sprites it went
+     over have to be put back on top. The area is the bounding box of the
+     points padded by the line width. ***/
+void xSpritesOver(GC dgc, XPoint *pnts, int cnt)
+{
+	if (sprites.empty() || !cnt) return;
+
+	XGCValues gcvals;
+	XGetGCValues(display,dgc,GCLineWidth,&gcvals);
+	int pad = gcvals.line_width / 2 + 1;
+	int x1 = INT_MAX;
+	int y1 = INT_MAX;
+	int x2 = INT_MIN;
+	int y2 = INT_MIN;
+
+	for(XPoint *pnt=pnts;pnt < pnts + cnt;++pnt)
+	{
+		x1 = min(x1,(int)pnt->x);
+		y1 = min(y1,(int)pnt->y);
+		x2 = max(x2,(int)pnt->x);
+		y2 = max(y2,(int)pnt->y);
+	}
+	xSpritesOver(x1 - pad,y1 - pad,x2 + pad + 1,y2 + pad + 1);
+}
+
+
+
+
+void xSpritesOver(int x1, int y1, int x2, int y2)
+{
+	for(auto &[name,sprite]: sprites)
+	{
+		if (sprite->visible) sprite->draw(x1,y1,x2 - x1,y2 - y1);
+	}
 }